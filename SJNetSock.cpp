@@ -19,26 +19,494 @@
 #include "SJNetSock.hpp"
 #include <vector>
 #include <cstring>
-#include <array>
 #include <algorithm>
+#include <climits>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <iterator>
 //LINUX
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/futex.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <net/if.h>
 #include <arpa/inet.h>
 //LINUX
 
-#define DATAPACKET_SIZE_T uint16_t
-#define DATAPACKET_SIZE_T_MAX UINT16_MAX
+#define DATAPACKET_SIZE_MAX UINT32_MAX
+#define DATAPACKET_HEADER_SIZE_MAX 5 //Varint of DATAPACKET_SIZE_MAX
+#define DATAPACKET_RECEIVED_SIZE_DEFAULT (64 << 20) //Bigger received packets are rejected, unless limit is raised
+#define SOCKET_RECEIVE_BUFFER_SIZE 65536 //Bigger TCP packets are received straight into their own buffer
+#define UDP_BATCH_MAX 64
+#define UDP_SEGMENTS_MAX 64 //Kernel limit of datagrams in one UDP_SEGMENT send
+#define UDP_PAYLOAD_MAX 65507 //IPv4 datagram without IP and UDP headers
+#define IO_URING_BUFFERS_COUNT 64 //Power of 2
+#define IO_URING_BUFFER_SIZE (SOCKET_RECEIVE_BUFFER_SIZE + 256) //Whole UDP packet with recvmsg header and sender address
+#define IO_URING_BUFFER_GROUP 0
+#define COMPRESSION_HASH_BITS 12
+#define COMPRESSION_MATCH_MIN 4
+#define COMPRESSION_OFFSET_MAX 65535
+#define COMPRESSION_LAST_LITERALS 5
+#define COMPRESSION_SIZE_MIN 16
+#define STATS_FLUSH_SYSCALLS 64 //Socket counters are added to aggregates after that many syscalls
+#define SHARED_MEMORY_MAGIC 0x534A4D31 //"SJM1", set when channel is initialized
+#define SHARED_MEMORY_CAPACITY_MAX (1ull << 40)
+#define ZERO_COPY_SIZE_MIN 16384 //Smaller sends are cheaper to copy than to pin and wait for completion
+#define RELIABLE_VERSION 1 //First byte of every ReliableUDPSocket datagram
+#define RELIABLE_DATAGRAM_SIZE 1200 //Messages are packed into datagrams up to that size (fits MTU of most paths)
+#define RELIABLE_MESSAGE_SIZE_MAX 65000 //With all headers and acknowledgement it fits in UDP_PAYLOAD_MAX
+#define RELIABLE_PENDING_MAX 4096 //Messages waiting to be sent or acknowledged
+#define RELIABLE_RECEIVE_WINDOW RELIABLE_PENDING_MAX //Messages buffered per stream behind missing one
+#define RELIABLE_ACK_RANGES_MAX 32
+#define RELIABLE_ACK_DELAY_MAX 5000000 //Nanoseconds, acknowledgement of single datagram waits up to that
+#define RELIABLE_INITIAL_RTT 100000000 //Nanoseconds, used before first RTT sample
+#define RELIABLE_INITIAL_WINDOW (10 * RELIABLE_DATAGRAM_SIZE)
+#define RELIABLE_MINIMUM_WINDOW (2 * RELIABLE_DATAGRAM_SIZE)
+#define RELIABLE_PACKET_THRESHOLD 3 //Datagram is lost when that many newer ones are acknowledged
+#define RELIABLE_PACING_BURST 10 //Datagrams sent back to back when pacing allows
+#define RELIABLE_PROBE_BACKOFF_MAX 6
+#define RELIABLE_FLAG_ACK 0x01
+#define RELIABLE_FLAG_PING 0x02
+#define RELIABLE_FLAG_COMPRESSED 0x80 //In frame flags, lower bits are Delivery
+#define TCP_SERVER_IO_THREAD_BITS 8 //Lowest bits of ConnectionID
+#define TCP_SERVER_IO_THREADS_MAX (1 << TCP_SERVER_IO_THREAD_BITS)
+#define TCP_SERVER_PENDING_MAX 1024 //Connection is not read while that many DataPackets wait to be handled or sent
 
 using namespace sj::API_RESERVED;
 
+//Writes packet size as varint (7 bits per byte, least significant first),
+//so packets smaller than 16 KiB have 1-2 bytes header. Returns header size.
+static size_t encodeDataPacketSize(size_t packetSize, char* header) {
+    size_t headerSize = 0;
+    while(packetSize >= 0x80){
+        header[headerSize++] = (char) ((packetSize & 0x7F) | 0x80);
+        packetSize >>= 7;
+    }
+    header[headerSize++] = (char) packetSize;
+
+    return headerSize;
+}
+
+
+//Set by DataPacket::setMaxReceivedSize
+static std::atomic<size_t> maxReceivedSize(DATAPACKET_RECEIVED_SIZE_DEFAULT);
+
+
+//Reads varint packet size. UNAVAILABLE means header is not complete yet,
+//ERROR means it's not valid.
+static sj::Status decodeDataPacketSize(const char* data, const size_t dataSize, size_t* packetSize, size_t* headerSize) {
+    std::uint64_t value = 0;
+    for(size_t i = 0; i < DATAPACKET_HEADER_SIZE_MAX; i++){
+        if(i == dataSize)
+            return sj::Status::UNAVAILABLE;
+
+        const std::uint8_t byte = (std::uint8_t) data[i];
+        value |= (std::uint64_t) (byte & 0x7F) << (7 * i);
+        if((byte & 0x80) == 0){
+            if(value > DATAPACKET_SIZE_MAX)
+                return sj::Status::ERROR;
+
+            *packetSize = value;
+            *headerSize = i + 1;
+            return sj::Status::OK;
+        }
+    }
+
+    return sj::Status::ERROR;
+}
+
+
+//Frame header is varint of packet size shifted left, with compression flag in lowest bit.
+static size_t encodeDataPacketHeader(const sj::DataPacket& dataPacket, char* header) {
+    return encodeDataPacketSize((dataPacket.size() << 1) | (dataPacket.isCompressed() ? 1 : 0), header);
+}
+
+
+//Reads frame header, same results as 'decodeDataPacketSize'.
+//ERROR also when packet is bigger than limit of received packets.
+static sj::Status decodeDataPacketHeader(const char* data, const size_t dataSize, size_t* packetSize, size_t* headerSize, bool* compressed) {
+    std::uint64_t value = 0;
+    for(size_t i = 0; i < DATAPACKET_HEADER_SIZE_MAX; i++){
+        if(i == dataSize)
+            return sj::Status::UNAVAILABLE;
+
+        const std::uint8_t byte = (std::uint8_t) data[i];
+        value |= (std::uint64_t) (byte & 0x7F) << (7 * i);
+        if((byte & 0x80) == 0){
+            //Checked before anything is allocated for packet
+            if((value >> 1) > maxReceivedSize.load(std::memory_order_relaxed))
+                return sj::Status::ERROR;
+
+            *packetSize = value >> 1;
+            *headerSize = i + 1;
+            *compressed = (value & 1) != 0;
+            return sj::Status::OK;
+        }
+    }
+
+    return sj::Status::ERROR;
+}
+
+
+//Appends length which did not fit in token nibble (255 means more bytes follow).
+static char* writeCompressionLength(char* output, size_t length) {
+    while(length >= 255){
+        *output++ = (char) 255;
+        length -= 255;
+    }
+    *output++ = (char) length;
+
+    return output;
+}
+
+
+//Writes literals followed by match ('matchLength' 0 ends block) as:
+//token (4 bits literals length, 4 bits match length), literals, 2 bytes offset.
+//Returns nullptr when sequence would not fit before 'outputEnd'.
+static char* writeCompressionSequence(char* output, const char* const outputEnd, const char* literals, const size_t literalsLength, const size_t offset, const size_t matchLength) {
+    const size_t sequenceSizeMax = 1 + literalsLength / 255 + 1 + literalsLength + 2 + matchLength / 255 + 1;
+    if((size_t) (outputEnd - output) < sequenceSizeMax)
+        return nullptr;
+
+    const size_t matchCode = matchLength != 0 ? matchLength - COMPRESSION_MATCH_MIN : 0;
+    *output++ = (char) ((std::min<size_t>(literalsLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+    if(literalsLength >= 15)
+        output = writeCompressionLength(output, literalsLength - 15);
+
+    if(literalsLength != 0)
+        std::memcpy(output, literals, literalsLength);
+    output += literalsLength;
+
+    if(matchLength != 0){
+        *output++ = (char) (offset & 0xFF);
+        *output++ = (char) (offset >> 8);
+        if(matchCode >= 15)
+            output = writeCompressionLength(output, matchCode - 15);
+    }
+
+    return output;
+}
+
+
+//LZ77 compression with single hash table lookup per position (speed over ratio).
+//Returns compressed size or 0 when it would not fit in 'outputCapacity'.
+static size_t compressBlock(const char* input, const size_t inputSize, char* output, const size_t outputCapacity) {
+    //Small packets have few positions to remember, so they clear only part of the table
+    int hashBits = 6;
+    while(hashBits < COMPRESSION_HASH_BITS && ((size_t) 1 << hashBits) < inputSize)
+        hashBits++;
+    std::uint32_t positions[1 << COMPRESSION_HASH_BITS];
+    std::memset(positions, 0, sizeof(std::uint32_t) << hashBits);
+
+    char* outputPtr = output;
+    const char* const outputEnd = output + outputCapacity;
+    size_t literalsBegin = 0;
+    size_t position = 0;
+    //Last bytes are always literals, so 4 bytes can be compared without bounds checks
+    const size_t matchesEnd = inputSize > COMPRESSION_LAST_LITERALS ? inputSize - COMPRESSION_LAST_LITERALS : 0;
+    while(position + COMPRESSION_MATCH_MIN <= matchesEnd){
+        std::uint32_t sequence;
+        std::memcpy(&sequence, input + position, sizeof(sequence));
+        const std::uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+        const size_t candidate = positions[hash];
+        positions[hash] = (std::uint32_t) position;
+
+        std::uint32_t candidateSequence;
+        std::memcpy(&candidateSequence, input + candidate, sizeof(candidateSequence));
+        if(candidate >= position || position - candidate > COMPRESSION_OFFSET_MAX || candidateSequence != sequence){
+            //Long runs without matches are scanned faster
+            position += 1 + ((position - literalsBegin) >> 6);
+            continue;
+        }
+
+        size_t matchBegin = position;
+        size_t matchSource = candidate;
+        size_t matchEnd = position + COMPRESSION_MATCH_MIN;
+        while(matchEnd < matchesEnd && input[matchEnd] == input[candidate + (matchEnd - position)])
+            matchEnd++;
+        while(matchBegin > literalsBegin && matchSource > 0 && input[matchBegin - 1] == input[matchSource - 1]){
+            matchBegin--;
+            matchSource--;
+        }
+
+        outputPtr = writeCompressionSequence(outputPtr, outputEnd, input + literalsBegin, matchBegin - literalsBegin, position - candidate, matchEnd - matchBegin);
+        if(outputPtr == nullptr)
+            return 0;
+
+        position = matchEnd;
+        literalsBegin = matchEnd;
+    }
+
+    outputPtr = writeCompressionSequence(outputPtr, outputEnd, input + literalsBegin, inputSize - literalsBegin, 0, 0);
+    if(outputPtr == nullptr)
+        return 0;
+
+    return outputPtr - output;
+}
+
+
+//Reads length which did not fit in token nibble, returns false at the end of input.
+static bool readCompressionLength(const unsigned char*& input, const unsigned char* const inputEnd, size_t& length) {
+    unsigned char byte;
+    do{
+        if(input == inputEnd)
+            return false;
+
+        byte = *input++;
+        length += byte;
+    } while(byte == 255);
+
+    return true;
+}
+
+
+//Reverses 'compressBlock', returns false when 'input' is corrupted 
+//or does not decompress to exactly 'outputSize' bytes.
+static bool decompressBlock(const char* input, const size_t inputSize, char* output, const size_t outputSize) {
+    const unsigned char* inputPtr = (const unsigned char*) input;
+    const unsigned char* const inputEnd = inputPtr + inputSize;
+    char* outputPtr = output;
+    char* const outputEnd = output + outputSize;
+
+    while(true){
+        if(inputPtr == inputEnd)
+            return false;
+
+        const unsigned char token = *inputPtr++;
+        size_t literalsLength = token >> 4;
+        if(literalsLength == 15 && readCompressionLength(inputPtr, inputEnd, literalsLength) == false)
+            return false;
+
+        if(literalsLength > (size_t) (inputEnd - inputPtr) || literalsLength > (size_t) (outputEnd - outputPtr))
+            return false;
+
+        if(literalsLength != 0)
+            std::memcpy(outputPtr, inputPtr, literalsLength);
+        inputPtr += literalsLength;
+        outputPtr += literalsLength;
+
+        //Last sequence has literals only
+        if(inputPtr == inputEnd)
+            return outputPtr == outputEnd;
+
+        if(inputEnd - inputPtr < 2)
+            return false;
+
+        const size_t offset = inputPtr[0] | (inputPtr[1] << 8);
+        inputPtr += 2;
+        size_t matchLength = token & 0x0F;
+        if(matchLength == 15 && readCompressionLength(inputPtr, inputEnd, matchLength) == false)
+            return false;
+        matchLength += COMPRESSION_MATCH_MIN;
+
+        if(offset == 0 || offset > (size_t) (outputPtr - output) || matchLength > (size_t) (outputEnd - outputPtr))
+            return false;
+
+        //Overlapping match repeats its own output byte by byte
+        const char* matchPtr = outputPtr - offset;
+        if(offset >= matchLength){
+            std::memcpy(outputPtr, matchPtr, matchLength);
+            outputPtr += matchLength;
+        }
+        else{
+            for(size_t i = 0; i < matchLength; i++)
+                *outputPtr++ = *matchPtr++;
+        }
+    }
+}
+
+
+//Totals returned by 'DataPacket::getCompressionStats'
+static struct {
+    std::atomic<std::uint64_t> compressedPackets{0};
+    std::atomic<std::uint64_t> skippedPackets{0};
+    std::atomic<std::uint64_t> decompressedPackets{0};
+    std::atomic<std::uint64_t> uncompressedBytes{0};
+    std::atomic<std::uint64_t> compressedBytes{0};
+    std::atomic<std::uint64_t> compressNanoseconds{0};
+    std::atomic<std::uint64_t> decompressNanoseconds{0};
+} compressionStats;
+
+
+//Nanoseconds since 'startTime'
+static std::uint64_t elapsedNanoseconds(const std::chrono::steady_clock::time_point startTime) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+//Monotonic time
+static std::uint64_t monotonicNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//Milliseconds left to 'deadline' (rounded up) for poll(), -1 when there is no deadline
+static int remainingMilliseconds(const std::uint64_t deadline) {
+    if(deadline == 0)
+        return -1;
+
+    const std::uint64_t now = monotonicNanoseconds();
+    if(now >= deadline)
+        return 0;
+
+    return (int) std::min<std::uint64_t>((deadline - now + 999999) / 1000000, INT_MAX);
+}
+
+
+//Sets or clears O_NONBLOCK of file descriptor
+static bool setNonBlocking(const int fd, const bool nonBlocking) {
+    const int flags = fcntl(fd, F_GETFL);
+    if(flags == -1)
+        return false;
+
+    return fcntl(fd, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) != -1;
+}
+
+
+//Moves 'message' iovecs past bytes already sent
+static void skipSentBytes(msghdr& message, size_t sentBytes) {
+    while(sentBytes != 0 && sentBytes >= message.msg_iov->iov_len){
+        sentBytes -= message.msg_iov->iov_len;
+        message.msg_iov++;
+        message.msg_iovlen--;
+    }
+    if(sentBytes != 0){
+        message.msg_iov->iov_base = (char*) message.msg_iov->iov_base + sentBytes;
+        message.msg_iov->iov_len -= sentBytes;
+    }
+}
+
+//Adds UDP_SEGMENT control message to 'message', 'control' has CMSG_SPACE(sizeof(uint16_t)) bytes
+static void setSegmentSize(msghdr& message, char* control, const std::uint16_t segmentSize) {
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(segmentSize));
+    cmsghdr* const controlMessage = CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = SOL_UDP;
+    controlMessage->cmsg_type = UDP_SEGMENT;
+    controlMessage->cmsg_len = CMSG_LEN(sizeof(segmentSize));
+    memcpy(CMSG_DATA(controlMessage), &segmentSize, sizeof(segmentSize));
+}
+
+
+//Size of datagrams joined by UDP_GRO, 'receivedBytes' when only one was received
+static size_t getSegmentSize(msghdr& message, const size_t receivedBytes) {
+    for(cmsghdr* controlMessage = CMSG_FIRSTHDR(&message); controlMessage != nullptr; controlMessage = CMSG_NXTHDR(&message, controlMessage)){
+        if(controlMessage->cmsg_level == SOL_UDP && controlMessage->cmsg_type == UDP_GRO){
+            int segmentSize;
+            memcpy(&segmentSize, CMSG_DATA(controlMessage), sizeof(segmentSize));
+            if(segmentSize > 0)
+                return segmentSize;
+        }
+    }
+
+    return receivedBytes;
+}
+
+
+//Removes datagrams which don't carry exactly one packet from joined ones ('segmentSize' bytes each, 
+//last can be shorter), the rest is moved together. Returns their size.
+static size_t removeInvalidDatagrams(char* datagrams, const size_t datagramsSize, const size_t segmentSize) {
+    size_t validSize = 0;
+    for(size_t segment = 0; segment < datagramsSize; segment += segmentSize){
+        const size_t datagramSize = std::min(segmentSize, datagramsSize - segment);
+        size_t packetSize, headerSize;
+        bool compressed;
+        if(decodeDataPacketHeader(datagrams + segment, datagramSize, &packetSize, &headerSize, &compressed) != sj::Status::OK || datagramSize - headerSize != packetSize)
+            continue;
+
+        if(validSize != segment)
+            memmove(datagrams + validSize, datagrams + segment, datagramSize);
+        validSize += datagramSize;
+    }
+
+    return validSize;
+}
+
+
+//Wrap-around order of zero copy send numbers
+static bool isSendBefore(const std::uint32_t sendId, const std::uint32_t otherSendId) {
+    return (std::int32_t) (sendId - otherSendId) < 0;
+}
+
+
+//Pins calling thread to one CPU
+static bool pinCurrentThread(const int cpu) {
+    if(cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+
+//Finds level and name of socket option
+static void toSocketOption(const sj::Option option, int* level, int* name) {
+    //Unknown option is rejected by kernel
+    *level = -1;
+    *name = -1;
+    switch(option){
+        case sj::Option::NO_DELAY:              *level = IPPROTO_TCP;   *name = TCP_NODELAY;    break;
+        case sj::Option::QUICK_ACK:             *level = IPPROTO_TCP;   *name = TCP_QUICKACK;   break;
+        case sj::Option::RECEIVE_BUFFER_SIZE:   *level = SOL_SOCKET;    *name = SO_RCVBUF;      break;
+        case sj::Option::SEND_BUFFER_SIZE:      *level = SOL_SOCKET;    *name = SO_SNDBUF;      break;
+        case sj::Option::BUSY_POLL:             *level = SOL_SOCKET;    *name = SO_BUSY_POLL;   break;
+        case sj::Option::ZERO_COPY:             *level = SOL_SOCKET;    *name = SO_ZEROCOPY;    break;
+        case sj::Option::SEGMENTATION_OFFLOAD:  *level = SOL_UDP;       *name = UDP_SEGMENT;    break;
+        case sj::Option::RECEIVE_OFFLOAD:       *level = SOL_UDP;       *name = UDP_GRO;        break;
+        case sj::Option::REUSE_ADDRESS:         *level = SOL_SOCKET;    *name = SO_REUSEADDR;   break;
+        case sj::Option::MULTICAST_TTL:         *level = IPPROTO_IP;    *name = IP_MULTICAST_TTL;   break;
+        case sj::Option::MULTICAST_LOOPBACK:    *level = IPPROTO_IP;    *name = IP_MULTICAST_LOOP;  break;
+    }
+}
+
+
 ///////////////////////////////////////////////
 //  DataPacket Class
 ///////////////////////////////////////////////
-sj::DataPacket::DataPacket() {
+sj::DataPacket::DataPacket() 
+    : buffer(nullptr), bufferSize(0), bufferCapacity(0), readPosition(0), compressed(false) {
+
+};
+
+
+///////////////////////////////////////////////
+sj::DataPacket::DataPacket(const DataPacket& other) 
+    : buffer(nullptr), bufferSize(0), bufferCapacity(0), readPosition(0), compressed(false) {
+    operator=(other);
+};
+
 
+///////////////////////////////////////////////
+sj::DataPacket::DataPacket(DataPacket&& other) noexcept 
+    : buffer(std::move(other.buffer)), bufferSize(other.bufferSize), 
+      bufferCapacity(other.bufferCapacity), readPosition(other.readPosition), compressed(other.compressed) {
+    other.bufferSize = 0;
+    other.bufferCapacity = 0;
+    other.readPosition = 0;
+    other.compressed = false;
 };
 
 
@@ -48,336 +516,5749 @@ sj::DataPacket::~DataPacket() {
 };
 
 
+///////////////////////////////////////////////
+sj::DataPacket& sj::DataPacket::operator=(const DataPacket& other) {
+    if(this == &other)
+        return *this;
+
+    bufferSize = 0;
+    readPosition = 0;
+    if(other.bufferSize != 0)
+        std::memcpy(grow(other.bufferSize), other.buffer.get(), other.bufferSize);
+    readPosition = other.readPosition;
+    compressed = other.compressed;
+
+    return *this;
+}
+
+
+///////////////////////////////////////////////
+sj::DataPacket& sj::DataPacket::operator=(DataPacket&& other) noexcept {
+    if(this == &other)
+        return *this;
+
+    buffer = std::move(other.buffer);
+    bufferSize = other.bufferSize;
+    bufferCapacity = other.bufferCapacity;
+    readPosition = other.readPosition;
+    compressed = other.compressed;
+
+    other.bufferSize = 0;
+    other.bufferCapacity = 0;
+    other.readPosition = 0;
+    other.compressed = false;
+    return *this;
+}
+
+
 ///////////////////////////////////////////////
 sj::Status sj::DataPacket::allDataReaded() {
-    return data.size() == 0 ? Status::OK : Status::ERROR;
+    return readPosition == bufferSize ? Status::OK : Status::ERROR;
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacket::reserve(const size_t capacity) {
+    if(capacity > bufferCapacity)
+        reallocate(capacity);
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacket::size() const {
+    return bufferSize;
+}
+
+
+///////////////////////////////////////////////
+const char* sj::DataPacket::data() const {
+    return buffer.get();
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacket::capacity() const {
+    return bufferCapacity;
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacket::clear() {
+    bufferSize = 0;
+    readPosition = 0;
+    compressed = false;
+}
+
+
+///////////////////////////////////////////////
+bool sj::DataPacket::compress(const size_t threshold) {
+    if(compressed)
+        return true;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    bool compressedNow = false;
+    if(bufferSize >= threshold && bufferSize >= COMPRESSION_SIZE_MIN){
+        //Original size followed by compressed block, all of it has to be smaller than original data
+        DataPacket compressedPacket = DataPacketPool::local().acquire();
+        compressedPacket.reserve(bufferSize);
+        const size_t headerSize = encodeDataPacketSize(bufferSize, compressedPacket.buffer.get());
+        const size_t blockSize = compressBlock(buffer.get(), bufferSize, compressedPacket.buffer.get() + headerSize, bufferSize - headerSize - 1);
+        if(blockSize != 0){
+            compressionStats.uncompressedBytes += bufferSize;
+            compressionStats.compressedBytes += headerSize + blockSize;
+
+            compressedPacket.bufferSize = headerSize + blockSize;
+            compressedPacket.compressed = true;
+            std::swap(*this, compressedPacket);
+            compressedNow = true;
+        }
+
+        DataPacketPool::local().release(std::move(compressedPacket));
+    }
+
+    if(compressedNow)
+        compressionStats.compressedPackets++;
+    else
+        compressionStats.skippedPackets++;
+    compressionStats.compressNanoseconds += elapsedNanoseconds(startTime);
+
+    return compressedNow;
+}
+
+
+///////////////////////////////////////////////
+bool sj::DataPacket::decompress() {
+    if(compressed == false)
+        return true;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    size_t originalSize, headerSize;
+    if(decodeDataPacketSize(buffer.get(), bufferSize, &originalSize, &headerSize) != Status::OK)
+        return false;
+
+    //Every compressed byte expands to at most 255 bytes, 
+    //so corrupted size cannot force huge allocation
+    if(originalSize > (bufferSize - headerSize) * 255 || originalSize > maxReceivedSize.load(std::memory_order_relaxed))
+        return false;
+
+    DataPacket originalPacket = DataPacketPool::local().acquire();
+    originalPacket.reserve(originalSize);
+    const bool decompressed = decompressBlock(buffer.get() + headerSize, bufferSize - headerSize, originalPacket.buffer.get(), originalSize);
+    if(decompressed){
+        originalPacket.bufferSize = originalSize;
+        std::swap(*this, originalPacket);
+
+        compressionStats.decompressedPackets++;
+        compressionStats.decompressNanoseconds += elapsedNanoseconds(startTime);
+    }
+
+    DataPacketPool::local().release(std::move(originalPacket));
+    return decompressed;
+}
+
+
+///////////////////////////////////////////////
+bool sj::DataPacket::isCompressed() const {
+    return compressed;
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacket::setMaxReceivedSize(const size_t maxSize) {
+    maxReceivedSize.store(std::min<size_t>(maxSize, DATAPACKET_SIZE_MAX), std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacket::getMaxReceivedSize() {
+    return maxReceivedSize.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+sj::CompressionStats sj::DataPacket::getCompressionStats() {
+    CompressionStats stats;
+    stats.compressedPackets = compressionStats.compressedPackets;
+    stats.skippedPackets = compressionStats.skippedPackets;
+    stats.decompressedPackets = compressionStats.decompressedPackets;
+    stats.uncompressedBytes = compressionStats.uncompressedBytes;
+    stats.compressedBytes = compressionStats.compressedBytes;
+    stats.compressNanoseconds = compressionStats.compressNanoseconds;
+    stats.decompressNanoseconds = compressionStats.decompressNanoseconds;
+    return stats;
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacket::reallocate(const size_t minimumCapacity) {
+    //Grow geometrically, so appending many small values is amortized O(1)
+    size_t newCapacity = std::max<size_t>(bufferCapacity * 2, 64);
+    if(newCapacity < minimumCapacity)
+        newCapacity = minimumCapacity;
+
+    std::unique_ptr<char[]> newBuffer(new char[newCapacity]);
+    if(bufferSize != 0)
+        std::memcpy(newBuffer.get(), buffer.get(), bufferSize);
+
+    buffer = std::move(newBuffer);
+    bufferCapacity = newCapacity;
+}
+
+
+///////////////////////////////////////////////
+sj::DataPacket& sj::DataPacket::writeBytes(const void* data, const size_t size) {
+    if(size > DATAPACKET_SIZE_MAX)
+        return (*this);
+
+    //Length and bytes copied at once, embedded NULs are kept
+    char header[DATAPACKET_HEADER_SIZE_MAX];
+    const size_t headerSize = encodeDataPacketSize(size, header);
+    char* const writePtr = grow(headerSize + size);
+    std::memcpy(writePtr, header, headerSize);
+    if(size != 0)
+        std::memcpy(writePtr + headerSize, data, size);
+
+    return (*this);
+}
+
+
+///////////////////////////////////////////////
+bool sj::DataPacket::readBytes(BytesView& value) {
+    const char* const readPtr = buffer.get() + readPosition;
+    const size_t unreadedBytes = bufferSize - readPosition;
+
+    size_t bytesSize;
+    size_t headerSize;
+    if(decodeDataPacketSize(readPtr, unreadedBytes, &bytesSize, &headerSize) != Status::OK || unreadedBytes - headerSize < bytesSize)
+        return false;
+
+    value = BytesView(readPtr + headerSize, bytesSize);
+    readPosition += headerSize + bytesSize;
+    return true;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::int8_t value) {
-    return operator<< <std::int8_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::int16_t value) { 
-    return operator<< <std::int16_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::int32_t value) {
-    return operator<< <std::int32_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::int64_t value) { 
-    return operator<< <std::int64_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::uint8_t value) {
-    return operator<< <std::uint8_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::uint16_t value) { 
-    return operator<< <std::uint16_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::uint32_t value) {
-    return operator<< <std::uint32_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::uint64_t value) { 
-    return operator<< <std::uint64_t>(value); 
+    return write(value);
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator<<(const std::string& value) {
-    for(auto strIt = value.begin(); strIt != value.end(); strIt++)
-        operator<<( (std::int8_t)(*strIt) );
+    return writeBytes(value.data(), value.size());
+}
 
-    operator<<( (std::int8_t)('\0') );
-    return (*this);
+
+///////////////////////////////////////////////
+sj::DataPacket& sj::DataPacket::operator<<(const char* value) {
+    return writeBytes(value, std::strlen(value));
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::int8_t& value) { 
-    return operator>> <std::int8_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::int16_t& value) { 
-    return operator>> <std::int16_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::int32_t& value) { 
-    return operator>> <std::int32_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::int64_t& value) { 
-    return operator>> <std::int64_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::uint8_t& value) { 
-    return operator>> <std::uint8_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::uint16_t& value) { 
-    return operator>> <std::uint16_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::uint32_t& value) { 
-    return operator>> <std::uint32_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::uint64_t& value) { 
-    return operator>> <std::uint64_t>(value); 
+    read(value);
+    return *this;
 }
 
 
 ///////////////////////////////////////////////
 sj::DataPacket& sj::DataPacket::operator>>(std::string& value) {
-    char currentChar = '\0';
-    value.clear();
-    do{
-        operator>>( (std::int8_t&)currentChar);
-        if(currentChar != '\0')
-            value.insert(value.end(), currentChar);
-    } while (currentChar != '\0');
-    
+    BytesView bytes;
+    if(readBytes(bytes))
+        value.assign(bytes.data(), bytes.size());
+
     return (*this);
 }
 
-
+
+///////////////////////////////////////////////
+sj::DataPacket& sj::DataPacket::operator>>(BytesView& value) {
+    readBytes(value);
+    return (*this);
+}
+
+
+///////////////////////////////////////////////
+//  DataPacketPool Class
+///////////////////////////////////////////////
+sj::DataPacketPool::DataPacketPool(const size_t packetCapacity, const size_t maxPackets, const size_t maxPacketCapacity) 
+    : packetCapacity(packetCapacity), maxPackets(maxPackets), maxPacketCapacity(maxPacketCapacity), hits(0), misses(0) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::DataPacketPool& sj::DataPacketPool::local() {
+    //Pool per thread needs no locking
+    static thread_local DataPacketPool localPool;
+    return localPool;
+}
+
+
+///////////////////////////////////////////////
+sj::DataPacket sj::DataPacketPool::acquire() {
+    if(dataPackets.empty()){
+        misses++;
+        DataPacket dataPacket;
+        dataPacket.reserve(packetCapacity);
+        return dataPacket;
+    }
+
+    hits++;
+    DataPacket dataPacket(std::move(dataPackets.back()));
+    dataPackets.pop_back();
+    return dataPacket;
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacketPool::release(DataPacket&& dataPacket) {
+    //Too small packets would have to allocate after 'acquire' anyway
+    if(dataPackets.size() >= maxPackets || dataPacket.capacity() < packetCapacity || dataPacket.capacity() > maxPacketCapacity)
+        return;
+
+    dataPacket.clear();
+    dataPackets.push_back(std::move(dataPacket));
+}
+
+
+///////////////////////////////////////////////
+void sj::DataPacketPool::release(std::vector<DataPacket>& dataPackets) {
+    for(DataPacket& dataPacket : dataPackets)
+        release(std::move(dataPacket));
+
+    dataPackets.clear();
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacketPool::getHits() {
+    return hits;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacketPool::getMisses() {
+    return misses;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::DataPacketPool::getSize() {
+    return dataPackets.size();
+}
+
+
+///////////////////////////////////////////////
+//  Endpoint Class
+///////////////////////////////////////////////
+sj::Endpoint::Endpoint() 
+    : address(htonl(INADDR_ANY)), port(0), valid(false) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::Endpoint::Endpoint(const std::string& ipAddress, const short port) 
+    : address(htonl(INADDR_ANY)), port(htons(port)), valid(false) {
+    in_addr parsedAddress;
+    if(inet_aton(ipAddress.c_str(), &parsedAddress) != 0){
+        address = parsedAddress.s_addr;
+        valid = true;
+    }
+}
+
+
+///////////////////////////////////////////////
+sj::Endpoint sj::Endpoint::unixSocket(const std::string& path) {
+    Endpoint endpoint;
+    endpoint.path = path;
+    //Filesystem path needs place for terminating null in 'sun_path'
+    endpoint.valid = path.empty() == false && path.size() + (path[0] == '@' ? 0 : 1) <= sizeof(sockaddr_un::sun_path);
+    return endpoint;
+}
+
+
+///////////////////////////////////////////////
+bool sj::Endpoint::isValid() const {
+    return valid;
+}
+
+
+///////////////////////////////////////////////
+bool sj::Endpoint::isUnix() const {
+    return path.empty() == false;
+}
+
+
+///////////////////////////////////////////////
+std::string sj::Endpoint::getIPAddress() const {
+    in_addr addr;
+    addr.s_addr = address;
+    char ipAddress[INET_ADDRSTRLEN];
+    if(inet_ntop(AF_INET, &addr, ipAddress, sizeof(ipAddress)) == nullptr)
+        return std::string();
+
+    return std::string(ipAddress);
+}
+
+
+///////////////////////////////////////////////
+short sj::Endpoint::getPort() const {
+    return (short) ntohs(port);
+}
+
+
+///////////////////////////////////////////////
+const std::string& sj::Endpoint::getPath() const {
+    return path;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::Endpoint::toSockaddr(sockaddr_storage& addr) const {
+    if(path.empty()){
+        sockaddr_in& inAddr = (sockaddr_in&) addr;
+        memset(&inAddr, 0, sizeof(inAddr));
+        inAddr.sin_family = AF_INET;
+        inAddr.sin_port = port;
+        inAddr.sin_addr.s_addr = address;
+        return sizeof(inAddr);
+    }
+
+    //Abstract address starts with null and its size excludes terminating one
+    sockaddr_un& unAddr = (sockaddr_un&) addr;
+    unAddr.sun_family = AF_UNIX;
+    const size_t pathSize = std::min(path.size(), sizeof(unAddr.sun_path) - 1);
+    memcpy(unAddr.sun_path, path.data(), pathSize);
+    unAddr.sun_path[pathSize] = '\0';
+    if(path[0] == '@'){
+        unAddr.sun_path[0] = '\0';
+        return offsetof(sockaddr_un, sun_path) + pathSize;
+    }
+
+    return offsetof(sockaddr_un, sun_path) + pathSize + 1;
+}
+
+
+///////////////////////////////////////////////
+void sj::Endpoint::fromSockaddr(const sockaddr_storage& addr, const size_t addrSize) {
+    if(addr.ss_family != AF_UNIX){
+        const sockaddr_in& inAddr = (const sockaddr_in&) addr;
+        address = inAddr.sin_addr.s_addr;
+        port = inAddr.sin_port;
+        path.clear();
+        valid = true;
+        return;
+    }
+
+    //Unbound Unix domain socket has no address, so it can't be replied to
+    const sockaddr_un& unAddr = (const sockaddr_un&) addr;
+    const size_t pathSize = addrSize > offsetof(sockaddr_un, sun_path) ? addrSize - offsetof(sockaddr_un, sun_path) : 0;
+    if(pathSize == 0)
+        path.clear();
+    else if(unAddr.sun_path[0] == '\0')
+        path = "@" + std::string(unAddr.sun_path + 1, pathSize - 1);
+    else
+        path.assign(unAddr.sun_path, strnlen(unAddr.sun_path, pathSize));
+
+    address = htonl(INADDR_ANY);
+    port = 0;
+    valid = path.empty() == false;
+}
+
+
+///////////////////////////////////////////////
+//  Histogram Class
+///////////////////////////////////////////////
+sj::Histogram::Histogram() 
+    : count(0), max(0) {
+    std::memset(buckets, 0, sizeof(buckets));
+}
+
+
+///////////////////////////////////////////////
+void sj::Histogram::record(const std::uint64_t value) {
+    buckets[bucketOf(value)]++;
+    count++;
+    max = std::max(max, value);
+}
+
+
+///////////////////////////////////////////////
+void sj::Histogram::add(const Histogram& other) {
+    for(size_t i = 0; i < BUCKETS_COUNT; i++)
+        buckets[i] += other.buckets[i];
+    count += other.count;
+    max = std::max(max, other.max);
+}
+
+
+///////////////////////////////////////////////
+void sj::Histogram::reset() {
+    std::memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    max = 0;
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::Histogram::getCount() const {
+    return count;
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::Histogram::getMax() const {
+    return max;
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::Histogram::getPercentile(const double percentile) const {
+    if(count == 0)
+        return 0;
+
+    //1 based rank of value at percentile
+    const double exactRank = std::min(std::max(percentile, 0.0), 100.0) / 100.0 * count;
+    std::uint64_t rank = (std::uint64_t) exactRank;
+    if(rank < exactRank || rank == 0)
+        rank++;
+
+    std::uint64_t seenValues = 0;
+    for(size_t i = 0; i < BUCKETS_COUNT; i++){
+        seenValues += buckets[i];
+        if(seenValues >= rank)
+            return std::min(bucketUpperBound(i), max);
+    }
+
+    return max;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::Histogram::bucketOf(const std::uint64_t value) {
+    //Values below 8 have own buckets, bigger ones share bucket 
+    //with values having the same highest 4 bits
+    if(value < 8)
+        return value;
+
+    const int highestBit = 63 - __builtin_clzll(value);
+    return (highestBit - 2) * 8 + ((value >> (highestBit - 3)) & 7);
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::Histogram::bucketUpperBound(const size_t bucket) {
+    if(bucket < 8)
+        return bucket;
+
+    const int highestBit = bucket / 8 + 2;
+    const std::uint64_t lowerBound = (std::uint64_t) (8 + bucket % 8) << (highestBit - 3);
+    return lowerBound + ((std::uint64_t) 1 << (highestBit - 3)) - 1;
+}
+
+
+//Raises 'maximum' to 'value' when it's smaller
+static void storeMax(std::atomic<std::uint64_t>& maximum, const std::uint64_t value) {
+    std::uint64_t current = maximum.load(std::memory_order_relaxed);
+    while(current < value && maximum.compare_exchange_weak(current, value, std::memory_order_relaxed) == false);
+}
+
+
+//Histogram recorded from many threads
+struct sj::API_RESERVED::AtomicHistogram{
+    std::atomic<std::uint64_t> buckets[Histogram::BUCKETS_COUNT];
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> max;
+
+    AtomicHistogram() : count(0), max(0) {
+        for(auto& bucket : buckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+    void record(const std::uint64_t value){
+        buckets[Histogram::bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        storeMax(max, value);
+    }
+
+    void snapshot(Histogram& histogram) const {
+        for(size_t i = 0; i < Histogram::BUCKETS_COUNT; i++)
+            histogram.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        histogram.count = count.load(std::memory_order_relaxed);
+        histogram.max = max.load(std::memory_order_relaxed);
+    }
+};
+
+
+//Stats added up from many sockets (whole process, clients of one listener)
+struct sj::API_RESERVED::SharedStats{
+    std::atomic<std::uint64_t> bytesSent{0};
+    std::atomic<std::uint64_t> bytesReceived{0};
+    std::atomic<std::uint64_t> packetsSent{0};
+    std::atomic<std::uint64_t> packetsReceived{0};
+    std::atomic<std::uint64_t> syscalls{0};
+    std::atomic<std::uint64_t> unavailable{0};
+    std::atomic<std::uint64_t> partialSends{0};
+    std::atomic<std::uint64_t> receiveBufferHighWater{0};
+    AtomicHistogram sentPacketSizes;
+    AtomicHistogram receivedPacketSizes;
+    AtomicHistogram sendNanoseconds;
+
+    //Adds 'counters' increments (high water is raised to its value)
+    void add(const SocketCounters& counters){
+        bytesSent.fetch_add(counters.bytesSent, std::memory_order_relaxed);
+        bytesReceived.fetch_add(counters.bytesReceived, std::memory_order_relaxed);
+        packetsSent.fetch_add(counters.packetsSent, std::memory_order_relaxed);
+        packetsReceived.fetch_add(counters.packetsReceived, std::memory_order_relaxed);
+        syscalls.fetch_add(counters.syscalls, std::memory_order_relaxed);
+        unavailable.fetch_add(counters.unavailable, std::memory_order_relaxed);
+        partialSends.fetch_add(counters.partialSends, std::memory_order_relaxed);
+        storeMax(receiveBufferHighWater, counters.receiveBufferHighWater);
+    }
+
+    sj::SocketStats snapshot() const {
+        sj::SocketStats stats = sj::SocketStats();
+        stats.counters.bytesSent = bytesSent.load(std::memory_order_relaxed);
+        stats.counters.bytesReceived = bytesReceived.load(std::memory_order_relaxed);
+        stats.counters.packetsSent = packetsSent.load(std::memory_order_relaxed);
+        stats.counters.packetsReceived = packetsReceived.load(std::memory_order_relaxed);
+        stats.counters.syscalls = syscalls.load(std::memory_order_relaxed);
+        stats.counters.unavailable = unavailable.load(std::memory_order_relaxed);
+        stats.counters.partialSends = partialSends.load(std::memory_order_relaxed);
+        stats.counters.receiveBufferHighWater = receiveBufferHighWater.load(std::memory_order_relaxed);
+        sentPacketSizes.snapshot(stats.sentPacketSizes);
+        receivedPacketSizes.snapshot(stats.receivedPacketSizes);
+        sendNanoseconds.snapshot(stats.sendNanoseconds);
+        return stats;
+    }
+};
+
+
+static std::atomic<bool> histogramsEnabled(false);
+
+
+//Created at first use and never destroyed, so sockets can be 
+//created and destroyed with other static objects
+static sj::API_RESERVED::SharedStats& processStats() {
+    static sj::API_RESERVED::SharedStats* const stats = new sj::API_RESERVED::SharedStats();
+    return *stats;
+}
+
+
+//Difference of 'counter' since last call, which is remembered in 'flushed'
+static std::uint64_t takeUnflushed(const std::atomic<std::uint64_t>& counter, std::atomic<std::uint64_t>& flushed) {
+    const std::uint64_t value = counter.load(std::memory_order_relaxed);
+    return value - flushed.exchange(value, std::memory_order_relaxed);
+}
+
+
+//Monotonic time of send start, 0 when histograms are disabled
+static std::uint64_t sendStartNanoseconds() {
+    if(histogramsEnabled.load(std::memory_order_relaxed) == false)
+        return 0;
+
+    return monotonicNanoseconds();
+}
+
+
+//Records 'value' in histogram of socket (allocated at first use) and in the same histogram of aggregates
+static void recordHistogram(std::atomic<sj::API_RESERVED::AtomicHistogram*>& histogram, sj::API_RESERVED::AtomicHistogram sj::API_RESERVED::SharedStats::* sharedHistogram, 
+                            sj::API_RESERVED::SharedStats* listenerStats, const std::uint64_t value) {
+    if(histogramsEnabled.load(std::memory_order_relaxed) == false)
+        return;
+
+    //'getStats' can read it from other thread, so it's published only when constructed
+    sj::API_RESERVED::AtomicHistogram* socketHistogram = histogram.load(std::memory_order_acquire);
+    if(socketHistogram == nullptr){
+        socketHistogram = new sj::API_RESERVED::AtomicHistogram();
+        sj::API_RESERVED::AtomicHistogram* expected = nullptr;
+        if(histogram.compare_exchange_strong(expected, socketHistogram, std::memory_order_acq_rel) == false){
+            delete socketHistogram;
+            socketHistogram = expected;
+        }
+    }
+
+    socketHistogram->record(value);
+    (processStats().*sharedHistogram).record(value);
+    if(listenerStats != nullptr)
+        (listenerStats->*sharedHistogram).record(value);
+}
+
+
+///////////////////////////////////////////////
+void sj::enableHistograms(const bool enabled) {
+    histogramsEnabled = enabled;
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::getProcessStats() {
+    return processStats().snapshot();
+}
+
+
+///////////////////////////////////////////////
+//  Socket class
+///////////////////////////////////////////////
+sj::API_RESERVED::Socket::Socket(const Mode mode) 
+    : socket_fd(-1), mode(mode), type(Type::TCP), unixDomain(false), boundDevice(0), boundInode(0), segmentationOffload(false), receiveOffload(false),
+      receiveBuffer(nullptr), receiveBufferBegin(0), receiveBufferEnd(0), largePacketEnd(0), batchBuffer(nullptr), unsentOffset(0), unsentFile(-1), unsentFileOffset(-1), unsentFileBytes(0), unsentFromPipe(false),
+      sentPacketSizes(nullptr), receivedPacketSizes(nullptr), sendNanoseconds(nullptr), zeroCopySends(0), zeroCopyCompleted(0), zeroCopyDeferred(false) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::API_RESERVED::Socket::~Socket() {
+    clearUnsent();
+    flushStats();
+    delete sentPacketSizes.load(std::memory_order_relaxed);
+    delete receivedPacketSizes.load(std::memory_order_relaxed);
+    delete sendNanoseconds.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::create(const Socket::Type type, const bool unixDomain) {
+    this->type = type;
+    this->unixDomain = unixDomain;
+    socket_fd = ::socket(unixDomain ? AF_UNIX : AF_INET, type == Type::TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if(socket_fd != -1 && applyOptions() != Status::OK){
+        close();
+        return -1;
+    }
+
+    return socket_fd;
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::bind(const Endpoint& local) {
+    sockaddr_storage addr;
+    const socklen_t addrSize = local.toSockaddr(addr);
+
+    //File of socket which was not removed (e.g. after crash) would make bind fail,
+    //but only nobody listening on it (connection refused) proves it's left over
+    const bool filePath = local.isUnix() && local.getPath()[0] != '@';
+    struct stat fileStatus;
+    if(filePath && lstat(local.getPath().c_str(), &fileStatus) == 0 && S_ISSOCK(fileStatus.st_mode)){
+        const int probe = ::socket(AF_UNIX, (type == Type::TCP ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(probe != -1){
+            if(::connect(probe, (sockaddr*)&addr, addrSize) == -1 && errno == ECONNREFUSED)
+                unlink(local.getPath().c_str());
+            ::close(probe);
+        }
+    }
+
+    const int bindStatus = ::bind(socket_fd, (sockaddr*)&addr, addrSize);
+    //File is remembered by its inode, so 'close' does not remove socket bound later by someone else
+    if(bindStatus == 0 && filePath && lstat(local.getPath().c_str(), &fileStatus) == 0){
+        boundPath = local.getPath();
+        boundDevice = fileStatus.st_dev;
+        boundInode = fileStatus.st_ino;
+    }
+
+    return bindStatus;
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::connect(const Endpoint& receiver) {
+    sockaddr_storage addr;
+    const socklen_t addrSize = receiver.toSockaddr(addr);
+    return ::connect(socket_fd, (sockaddr*)&addr, addrSize);
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::setOption(const int level, const int option, const int value) {
+    return ::setsockopt(socket_fd, level, option, &value, sizeof(value));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::setOption(const Option option, const int value) {
+    //Applied at once to existing socket, otherwise when it's created
+    if(socket_fd != -1 && applyOption(option, value) == -1)
+        return Status::ERROR;
+
+    if(option == Option::SEGMENTATION_OFFLOAD)
+        segmentationOffload = value != 0;
+    if(option == Option::RECEIVE_OFFLOAD)
+        receiveOffload = value != 0;
+
+    for(auto& storedOption : options){
+        if(storedOption.first == option){
+            storedOption.second = value;
+            return Status::OK;
+        }
+    }
+
+    options.push_back(std::make_pair(option, value));
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::getOption(const Option option, int* value) {
+    //Kernel has segment size of socket, not the option
+    if(socket_fd == -1 || option == Option::SEGMENTATION_OFFLOAD){
+        for(const auto& storedOption : options){
+            if(storedOption.first == option){
+                *value = storedOption.second;
+                return Status::OK;
+            }
+        }
+
+        return Status::ERROR;
+    }
+
+    int level, name;
+    toSocketOption(option, &level, &name);
+    socklen_t valueSize = sizeof(*value);
+    if(::getsockopt(socket_fd, level, name, value, &valueSize) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::inheritFrom(const Socket& listenSocket) {
+    listenerStats = listenSocket.acceptedStats;
+    unixDomain = listenSocket.unixDomain;
+
+    //Kernel copies most of options to accepted socket, but not all of them (QUICK_ACK)
+    options = listenSocket.options;
+    return applyOptions();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::applyOptions() {
+    for(const auto& storedOption : options){
+        int level, name;
+        toSocketOption(storedOption.first, &level, &name);
+        //TCP, UDP and IP options are skipped, so transport can be switched without changing them
+        if(unixDomain && (level == IPPROTO_TCP || level == IPPROTO_UDP || level == IPPROTO_IP || storedOption.first == Option::ZERO_COPY))
+            continue;
+
+        if(applyOption(storedOption.first, storedOption.second) == -1)
+            return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::applyOption(const Option option, const int value) {
+    int level, name;
+    toSocketOption(option, &level, &name);
+
+    //UDP_SEGMENT set on socket would split every bigger datagram, so segment size is given 
+    //only to chosen sends. Here it's only checked if kernel supports it.
+    if(option == Option::SEGMENTATION_OFFLOAD){
+        int segmentSize;
+        socklen_t segmentSizeSize = sizeof(segmentSize);
+        return ::getsockopt(socket_fd, level, name, &segmentSize, &segmentSizeSize);
+    }
+
+    return setOption(level, name, value);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::receiveInto(DataPacket& dataPacket) {
+    do{
+        //Check if whole packet is already stored in buffer
+        const Status extractStatus = extractDataPacket(dataPacket);
+        if(extractStatus != Status::UNAVAILABLE)
+            return extractStatus;
+
+        //Every UDP datagram carries whole packet, 
+        //so incomplete one will never be finished
+        if(type == Type::UDP){
+            receiveBufferBegin = 0;
+            receiveBufferEnd = 0;
+        }
+
+        //if buffer dont have full packet in it,
+        //try to receive some data to it
+        Status status = fillReceiveBuffer();
+        if(status != Status::OK)//When mode is non-blocking, function return here
+            return status;
+    } while(true);//Repeat until any full packet will be available in packet buffer
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets) {
+    *receivedPackets = 0;
+    bool dataReceived = false;
+    do{
+        //Take every packet completed in buffer in one pass
+        const Status extractStatus = extractDataPackets(dataPackets, receivedPackets);
+        if(extractStatus != Status::OK)
+            return extractStatus;
+
+        if(*receivedPackets != 0)
+            return Status::OK;
+
+        if(dataReceived && mode == Mode::NON_BLOCKING)
+            return Status::UNAVAILABLE;
+
+        //Every UDP datagram carries whole packet, 
+        //so incomplete one will never be finished
+        if(type == Type::UDP){
+            receiveBufferBegin = 0;
+            receiveBufferEnd = 0;
+        }
+
+        Status status = fillReceiveBuffer();
+        if(status != Status::OK)
+            return status;
+
+        dataReceived = true;
+    } while(true);//BLOCKING mode returns with at least one packet
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
+    const ssize_t recvStatus = recv(socket_fd, buffer, bufferSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+    countSyscall();
+
+    if(recvStatus == -1){
+        *readedBytes = 0;
+
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            countUnavailable();
+            return Status::UNAVAILABLE;
+        }
+
+        return Status::ERROR;
+    }
+
+    *readedBytes = recvStatus;
+    countReceived(recvStatus);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendTo(DataPacket& dataPacket, const Endpoint* receiver) {
+    if(dataPacket.size() > DATAPACKET_SIZE_MAX)
+        return Status::ERROR;
+
+    //Packet size and packet data are sent straight from their storage
+    char header[DATAPACKET_HEADER_SIZE_MAX];
+    iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = encodeDataPacketHeader(dataPacket, header);
+    iov[1].iov_base = dataPacket.buffer.get();
+    iov[1].iov_len = dataPacket.size();
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = dataPacket.size() != 0 ? 2 : 1;
+
+    //UDP with receiver IP addres
+    sockaddr_storage addr;
+    if(receiver != nullptr){
+        if(receiver->isValid() == false)
+            return Status::ERROR;
+
+        message.msg_name = &addr;
+        message.msg_namelen = receiver->toSockaddr(addr);
+    }
+
+    const Status status = sendMessage(message);
+    if(status == Status::OK)
+        countSentPacket(dataPacket.size());
+
+    return status;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendTo(DataPacket* dataPackets, const size_t dataPacketsCount) {
+    //Two iovecs (size, data) per packet
+    const size_t maxPacketsPerMessage = IOV_MAX / 2;
+    char headers[maxPacketsPerMessage][DATAPACKET_HEADER_SIZE_MAX];
+    iovec iov[maxPacketsPerMessage * 2];
+
+    for(size_t i = 0; i < dataPacketsCount; i++){
+        if(dataPackets[i].size() > DATAPACKET_SIZE_MAX)
+            return Status::ERROR;
+    }
+
+    size_t firstPacket = 0;
+    while(firstPacket < dataPacketsCount){
+        const size_t packetsInMessage = std::min(maxPacketsPerMessage, dataPacketsCount - firstPacket);
+        size_t iovCount = 0;
+        for(size_t i = 0; i < packetsInMessage; i++){
+            DataPacket& dataPacket = dataPackets[firstPacket + i];
+
+            iov[iovCount].iov_base = headers[i];
+            iov[iovCount].iov_len = encodeDataPacketHeader(dataPacket, headers[i]);
+            iovCount++;
+
+            if(dataPacket.size() != 0){
+                iov[iovCount].iov_base = dataPacket.buffer.get();
+                iov[iovCount].iov_len = dataPacket.size();
+                iovCount++;
+            }
+        }
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = iovCount;
+
+        //UNAVAILABLE after some messages were already sent, would leave caller 
+        //without knowing which packets are gone, so the rest waits in socket
+        const Status status = sendMessage(message, 0, firstPacket != 0);
+        if(status != Status::OK)
+            return status;
+
+        for(size_t i = 0; i < packetsInMessage; i++)
+            countSentPacket(dataPackets[firstPacket + i].size());
+        firstPacket += packetsInMessage;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendTo(const void* data, const size_t dataSize, const Endpoint* receiver) {
+    //Raw bytes can't go in the middle of partially sent DataPacket
+    const Status flushStatus = flushUnsent();
+    if(flushStatus != Status::OK)
+        return flushStatus;
+
+    ssize_t sendStatus = -1;
+    //UDP with receiver IP addres
+    if(receiver != nullptr){
+        if(receiver->isValid() == false)
+            return Status::ERROR;
+
+        sockaddr_storage addr;
+        const socklen_t addrSize = receiver->toSockaddr(addr);
+        sendStatus = ::sendto(socket_fd, data, dataSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0, (sockaddr*) &addr, addrSize);
+    }
+    //TCP or UDP with connected receiver
+    else
+        sendStatus = ::send(socket_fd, data, dataSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+    countSyscall();
+
+    if(sendStatus == -1){
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            countUnavailable();
+            return Status::UNAVAILABLE;
+        }
+
+        return Status::ERROR;
+    }
+    
+    countSent(sendStatus, (size_t) sendStatus < dataSize);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendBatch(DataPacket* dataPackets, const size_t dataPacketsCount, const Endpoint* receivers, const size_t receiversCount, size_t* sentPackets) {
+    *sentPackets = 0;
+    if(receiversCount != 1 && receiversCount != dataPacketsCount)
+        return Status::ERROR;
+
+    for(size_t i = 0; i < dataPacketsCount; i++){
+        if(dataPackets[i].size() > DATAPACKET_SIZE_MAX || receivers[receiversCount == 1 ? 0 : i].isValid() == false)
+            return Status::ERROR;
+    }
+
+    //Every packet is one datagram: size and data iovecs with receiver address.
+    //With segmentation offload, packets of the same size going to the same receiver
+    //are joined into one message, which kernel splits into datagrams again.
+    char headers[UDP_BATCH_MAX][DATAPACKET_HEADER_SIZE_MAX];
+    iovec iov[UDP_BATCH_MAX][2];
+    sockaddr_storage addrs[UDP_BATCH_MAX];
+    socklen_t addrSizes[UDP_BATCH_MAX];
+    mmsghdr messages[UDP_BATCH_MAX];
+    size_t messagePackets[UDP_BATCH_MAX];
+    alignas(cmsghdr) char controls[UDP_BATCH_MAX][CMSG_SPACE(sizeof(std::uint16_t))];
+
+    //Single receiver is converted only once
+    if(receiversCount == 1)
+        addrSizes[0] = receivers[0].toSockaddr(addrs[0]);
+
+    while(*sentPackets < dataPacketsCount){
+        const size_t firstPacket = *sentPackets;
+        const size_t packetsInBatch = std::min<size_t>(UDP_BATCH_MAX, dataPacketsCount - firstPacket);
+
+        for(size_t i = 0; i < packetsInBatch; i++){
+            DataPacket& dataPacket = dataPackets[firstPacket + i];
+            iov[i][0].iov_base = headers[i];
+            iov[i][0].iov_len = encodeDataPacketHeader(dataPacket, headers[i]);
+            iov[i][1].iov_base = dataPacket.buffer.get();
+            iov[i][1].iov_len = dataPacket.size();
+
+            if(receiversCount != 1)
+                addrSizes[i] = receivers[firstPacket + i].toSockaddr(addrs[i]);
+        }
+
+        const bool joinPackets = segmentationOffload && unixDomain == false;
+        size_t messagesCount = 0;
+        for(size_t i = 0; i < packetsInBatch; i += messagePackets[messagesCount++]){
+            //Only the last datagram of message can be shorter than segment
+            const size_t segmentSize = iov[i][0].iov_len + iov[i][1].iov_len;
+            size_t messageSize = segmentSize;
+            size_t packetsInMessage = 1;
+            while(joinPackets && i + packetsInMessage < packetsInBatch && packetsInMessage < UDP_SEGMENTS_MAX){
+                const size_t next = i + packetsInMessage;
+                const size_t datagramSize = iov[next][0].iov_len + iov[next][1].iov_len;
+                if(datagramSize > segmentSize || messageSize + datagramSize > UDP_PAYLOAD_MAX ||
+                   (receiversCount != 1 && (addrSizes[next] != addrSizes[i] || memcmp(&addrs[next], &addrs[i], addrSizes[i]) != 0)))
+                    break;
+
+                messageSize += datagramSize;
+                packetsInMessage++;
+                if(datagramSize < segmentSize)
+                    break;
+            }
+
+            mmsghdr& message = messages[messagesCount];
+            memset(&message, 0, sizeof(message));
+            message.msg_hdr.msg_iov = iov[i];
+            message.msg_hdr.msg_iovlen = packetsInMessage == 1 && iov[i][1].iov_len == 0 ? 1 : packetsInMessage * 2;
+            message.msg_hdr.msg_name = receiversCount == 1 ? &addrs[0] : &addrs[i];
+            message.msg_hdr.msg_namelen = receiversCount == 1 ? addrSizes[0] : addrSizes[i];
+            if(packetsInMessage != 1)
+                setSegmentSize(message.msg_hdr, controls[messagesCount], segmentSize);
+            messagePackets[messagesCount] = packetsInMessage;
+        }
+
+        const int sendStatus = ::sendmmsg(socket_fd, messages, messagesCount, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+        countSyscall();
+        if(sendStatus == -1){
+            if(errno == EINTR)
+                continue;
+
+            //Network card can't do it or segment doesn't fit in its MTU, packets are sent one by one since now
+            if((errno == EIO || errno == EINVAL) && messagePackets[0] != 1){
+                segmentationOffload = false;
+                continue;
+            }
+
+            if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                countUnavailable();
+                return Status::UNAVAILABLE;
+            }
+
+            return Status::ERROR;
+        }
+
+        for(int i = 0; i < sendStatus; i++){
+            countSent(messages[i].msg_len, false);
+            for(size_t packet = 0; packet < messagePackets[i]; packet++)
+                countSentPacket(dataPackets[*sentPackets + packet].size());
+            *sentPackets += messagePackets[i];
+        }
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendSegments(const void* data, const size_t dataSize, const size_t segmentSize, const Endpoint* receiver) {
+    if(segmentSize == 0 || segmentSize > UINT16_MAX)
+        return Status::ERROR;
+
+    iovec iov;
+    iov.iov_base = (void*) data;
+    iov.iov_len = dataSize;
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    sockaddr_storage addr;
+    if(receiver != nullptr){
+        if(receiver->isValid() == false)
+            return Status::ERROR;
+
+        message.msg_name = &addr;
+        message.msg_namelen = receiver->toSockaddr(addr);
+    }
+
+    //Data fitting in one datagram is sent as usual
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(std::uint16_t))];
+    if(dataSize > segmentSize)
+        setSegmentSize(message, control, segmentSize);
+
+    ssize_t sendStatus;
+    do{
+        sendStatus = ::sendmsg(socket_fd, &message, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+        countSyscall();
+    } while(sendStatus == -1 && errno == EINTR);
+
+    if(sendStatus == -1){
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            countUnavailable();
+            return Status::UNAVAILABLE;
+        }
+
+        return Status::ERROR;
+    }
+
+    countSent(sendStatus, false);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::receiveSegmentsInto(void* buffer, const size_t bufferSize, size_t* readedBytes, size_t* segmentSize) {
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = bufferSize;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t recvStatus;
+    do{
+        recvStatus = ::recvmsg(socket_fd, &message, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+        countSyscall();
+    } while(recvStatus == -1 && errno == EINTR);
+
+    if(recvStatus == -1){
+        *readedBytes = 0;
+        *segmentSize = 0;
+
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            countUnavailable();
+            return Status::UNAVAILABLE;
+        }
+
+        return Status::ERROR;
+    }
+
+    *readedBytes = recvStatus;
+    *segmentSize = getSegmentSize(message, recvStatus);
+    countReceived(recvStatus);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::receiveBatch(std::vector<DataPacket>& dataPackets, const size_t maxPackets, size_t* receivedPackets, std::vector<Endpoint>* senders) {
+    *receivedPackets = 0;
+    const size_t slotSize = SOCKET_RECEIVE_BUFFER_SIZE;
+    const size_t packetsInBatch = std::min<size_t>(UDP_BATCH_MAX, maxPackets);
+    if(packetsInBatch == 0)
+        return Status::OK;
+
+    //Allocated at first receive - pages untouched by recvmmsg()
+    //are not occupying resident memory
+    if(batchBuffer == nullptr)
+        batchBuffer.reset(new char[UDP_BATCH_MAX * slotSize]);
+
+    iovec iov[UDP_BATCH_MAX];
+    sockaddr_storage addrs[UDP_BATCH_MAX];
+    mmsghdr messages[UDP_BATCH_MAX];
+    alignas(cmsghdr) char controls[UDP_BATCH_MAX][CMSG_SPACE(sizeof(int))];
+    memset(messages, 0, packetsInBatch * sizeof(mmsghdr));
+
+    const bool joinedDatagrams = receiveOffload && unixDomain == false;
+    for(size_t i = 0; i < packetsInBatch; i++){
+        iov[i].iov_base = batchBuffer.get() + i * slotSize;
+        iov[i].iov_len = slotSize;
+        messages[i].msg_hdr.msg_iov = &iov[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &addrs[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        if(joinedDatagrams){
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+    }
+
+    //BLOCKING mode waits for first datagram and takes the rest only if already available
+    int receiveStatus;
+    do{
+        receiveStatus = ::recvmmsg(socket_fd, messages, packetsInBatch, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : MSG_WAITFORONE, nullptr);
+        countSyscall();
+    } while(receiveStatus == -1 && errno == EINTR);
+
+    if(receiveStatus == -1){
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            countUnavailable();
+            return Status::UNAVAILABLE;
+        }
+
+        return Status::ERROR;
+    }
+
+    for(int i = 0; i < receiveStatus; i++){
+        const size_t receivedBytes = messages[i].msg_len;
+        countReceived(receivedBytes);
+
+        //Joined datagrams are taken one by one, as if they were received separately
+        const size_t segmentSize = joinedDatagrams ? getSegmentSize(messages[i].msg_hdr, receivedBytes) : receivedBytes;
+        for(size_t segment = 0; segment < receivedBytes; segment += segmentSize){
+            const char* const datagramPtr = batchBuffer.get() + i * slotSize + segment;
+            const size_t datagramSize = std::min(segmentSize, receivedBytes - segment);
+
+            //Datagrams not carrying exactly one packet are dropped
+            size_t packetSize, headerSize;
+            bool compressed;
+            if(decodeDataPacketHeader(datagramPtr, datagramSize, &packetSize, &headerSize, &compressed) != Status::OK || datagramSize - headerSize != packetSize)
+                continue;
+
+            dataPackets.push_back(DataPacketPool::local().acquire());
+            if(packetSize != 0)
+                memcpy(dataPackets.back().grow(packetSize), datagramPtr + headerSize, packetSize);
+
+            dataPackets.back().compressed = compressed;
+            if(dataPackets.back().decompress() == false){
+                DataPacketPool::local().release(std::move(dataPackets.back()));
+                dataPackets.pop_back();
+                continue;
+            }
+
+            if(senders != nullptr){
+                senders->emplace_back();
+                senders->back().fromSockaddr(addrs[i], messages[i].msg_hdr.msg_namelen);
+            }
+
+            countReceivedPacket(packetSize);
+            (*receivedPackets)++;
+        }
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendFile(const int fd, const std::int64_t offset, const size_t length, const bool asDataPacket, size_t* sentBytes) {
+    *sentBytes = 0;
+    struct stat fileStatus;
+    if(fstat(fd, &fileStatus) == -1 || (asDataPacket && length > DATAPACKET_SIZE_MAX))
+        return Status::ERROR;
+
+    //sendfile reads only files which can be mapped, pipe is moved into socket with splice
+    const bool fromPipe = S_ISFIFO(fileStatus.st_mode);
+    if(offset < -1 || (fromPipe && offset != -1))
+        return Status::ERROR;
+
+    //Header announces 'length', so all of it have to be available before header is sent
+    if(asDataPacket && S_ISREG(fileStatus.st_mode)){
+        const off_t position = offset == -1 ? lseek(fd, 0, SEEK_CUR) : offset;
+        if(position == -1 || (std::uint64_t) position + length > (std::uint64_t) fileStatus.st_size)
+            return Status::ERROR;
+    }
+    //Waiting for pipe in the middle of DataPacket would block NON_BLOCKING socket
+    if(asDataPacket && fromPipe && mode == Mode::NON_BLOCKING){
+        int availableBytes = 0;
+        if(ioctl(fd, FIONREAD, &availableBytes) == -1)
+            return Status::ERROR;
+        if((size_t) availableBytes < length){
+            const int pipeSize = fcntl(fd, F_GETPIPE_SZ);
+            return pipeSize == -1 || length > (size_t) pipeSize ? Status::ERROR : Status::UNAVAILABLE;
+        }
+    }
+
+    //File can't go in the middle of partially sent DataPacket
+    const Status flushStatus = flushUnsent();
+    if(flushStatus != Status::OK)
+        return flushStatus;
+
+    const std::uint64_t startNanoseconds = sendStartNanoseconds();
+    if(asDataPacket){
+        //Header is held back (MSG_MORE) until file data follows it
+        char header[DATAPACKET_HEADER_SIZE_MAX];
+        iovec iov;
+        iov.iov_base = header;
+        iov.iov_len = encodeDataPacketSize(length << 1, header);
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        const Status status = sendMessage(message, length != 0 ? MSG_MORE : 0);
+        if(status != Status::OK)
+            return status;
+    }
+
+    off_t fileOffset = offset;
+    //Rest of header can wait in socket already, file data have to wait after it then
+    bool keepRest = length != 0 && getUnsentBytes() != 0;
+    while(*sentBytes < length && keepRest == false){
+        const size_t remainingBytes = length - *sentBytes;
+        ssize_t sendStatus;
+        if(fromPipe)
+            sendStatus = splice(fd, nullptr, socket_fd, nullptr, remainingBytes, SPLICE_F_MOVE | (mode == Mode::NON_BLOCKING ? SPLICE_F_NONBLOCK : 0));
+        else
+            sendStatus = sendfile(socket_fd, fd, offset == -1 ? nullptr : &fileOffset, remainingBytes);
+        countSyscall();
+
+        if(sendStatus == -1){
+            if(errno == EINTR)
+                continue;
+
+            if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                countUnavailable();
+                if(asDataPacket == false){
+                    if(*sentBytes == 0)
+                        return Status::UNAVAILABLE;
+                    break;
+                }
+
+                //Rest of DataPacket have to follow its header, so it waits in socket like rest of other DataPackets
+                keepRest = true;
+                continue;
+            }
+
+            //Stream can't continue with incomplete DataPacket
+            if(asDataPacket)
+                close();
+            return Status::ERROR;
+        }
+
+        //File ended earlier
+        if(sendStatus == 0){
+            if(asDataPacket == false)
+                return Status::OK;
+
+            close();
+            return Status::ERROR;
+        }
+
+        *sentBytes += sendStatus;
+        countSent(sendStatus, *sentBytes < length);
+    }
+
+    //Descriptor is duplicated, so caller can close it at once
+    if(keepRest){
+        unsentFile = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if(unsentFile == -1){
+            close();
+            return Status::ERROR;
+        }
+        unsentFileOffset = fileOffset;
+        unsentFileBytes = length - *sentBytes;
+        unsentFromPipe = fromPipe;
+        countSentPacket(length);
+        return Status::OK;
+    }
+
+    if(asDataPacket)
+        countSentPacket(length);
+    if(startNanoseconds != 0)
+        countSendTime(sendStartNanoseconds() - startNanoseconds);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendZeroCopy(DataPacket& dataPacket, std::uint32_t* sendId) {
+    *sendId = zeroCopySends - 1;
+    if(dataPacket.size() > DATAPACKET_SIZE_MAX)
+        return Status::ERROR;
+
+    //Header lives on stack, so it can't be pinned until completion like data
+    char header[DATAPACKET_HEADER_SIZE_MAX];
+    iovec iov;
+    iov.iov_base = header;
+    iov.iov_len = encodeDataPacketHeader(dataPacket, header);
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    Status status = sendMessage(message, dataPacket.size() != 0 ? MSG_MORE : 0);
+    if(status == Status::OK && dataPacket.size() != 0)
+        status = sendZeroCopyData(dataPacket.buffer.get(), dataPacket.size(), true, sendId);
+    if(status == Status::OK)
+        countSentPacket(dataPacket.size());
+
+    return status;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendZeroCopy(const void* data, const size_t dataSize, std::uint32_t* sendId) {
+    return sendZeroCopyData(data, dataSize, false, sendId);
+}
+
+
+///////////////////////////////////////////////
+bool sj::API_RESERVED::Socket::isSendCompleted(const std::uint32_t sendId) {
+    if(isSendBefore(sendId, zeroCopyCompleted))
+        return true;
+
+    readSendCompletions();
+    return isSendBefore(sendId, zeroCopyCompleted);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::waitForSendCompletion(const std::uint32_t sendId, const int timeoutMs) {
+    const std::uint64_t deadline = timeoutMs < 0 ? 0 : monotonicNanoseconds() + (std::uint64_t) timeoutMs * 1000000;
+    while(isSendCompleted(sendId) == false){
+        //Notifications in error queue make socket report POLLERR
+        pollfd notified = {socket_fd, 0, 0};
+        const int pollStatus = ::poll(&notified, 1, remainingMilliseconds(deadline));
+        if(pollStatus == -1 && errno == EINTR)
+            continue;
+
+        if(pollStatus == 0)
+            return Status::UNAVAILABLE;
+
+        //Socket is ready without notifications, so it has error or was hung up
+        if(pollStatus == -1 || readSendCompletions() == 0)
+            return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::getFD() {
+    return socket_fd;
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::asignFD(const int fd) {
+    socket_fd = fd;
+}
+
+
+///////////////////////////////////////////////
+sj::Mode sj::API_RESERVED::Socket::getMode() {
+    return mode;
+}
+
+
+///////////////////////////////////////////////
+int sj::API_RESERVED::Socket::close() {
+    const int closeValue = ::close(socket_fd);
+    if(closeValue != -1){
+        socket_fd = -1;
+        //Next connection can be accepted by other listener
+        flushStats();
+        listenerStats.reset();
+        //Partial packets are meaningless for next connection
+        receiveBufferBegin = 0;
+        receiveBufferEnd = 0;
+        largePacket = DataPacket();
+        largePacketEnd = 0;
+        clearUnsent();
+        //Numbering starts again on next socket
+        zeroCopySends = 0;
+        zeroCopyCompleted = 0;
+        zeroCopyCompletedRanges.clear();
+        zeroCopyDeferred = false;
+
+        if(boundPath.empty() == false){
+            struct stat fileStatus;
+            if(lstat(boundPath.c_str(), &fileStatus) == 0 && fileStatus.st_dev == boundDevice && fileStatus.st_ino == boundInode)
+                unlink(boundPath.c_str());
+            boundPath.clear();
+        }
+    }
+
+    return closeValue;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::extractDataPacket(DataPacket& dataPacket) {
+    //Packet bigger than receive buffer is completed in its own buffer
+    if(largePacket.size() != 0){
+        if(largePacketEnd != largePacket.size())
+            return Status::UNAVAILABLE;
+
+        countReceivedPacket(largePacket.size());
+        if(largePacket.decompress() == false){
+            largePacket = DataPacket();
+            largePacketEnd = 0;
+            return Status::ERROR;
+        }
+
+        if(dataPacket.size() == 0)
+            dataPacket = std::move(largePacket);
+        else
+            memcpy(dataPacket.grow(largePacket.size()), largePacket.data(), largePacket.size());
+
+        largePacket = DataPacket();
+        largePacketEnd = 0;
+        return Status::OK;
+    }
+
+    //Packet size is parsed in place
+    size_t packetSize, headerSize;
+    bool compressed;
+    const size_t bufferedBytes = receiveBufferEnd - receiveBufferBegin;
+    const char* const packetPtr = receiveBuffer.get() + receiveBufferBegin;
+    const Status headerStatus = decodeDataPacketHeader(packetPtr, bufferedBytes, &packetSize, &headerSize, &compressed);
+    if(headerStatus == Status::ERROR){
+        //Rest of TCP stream cannot be split into packets, UDP datagram is just dropped
+        receiveBufferBegin = 0;
+        receiveBufferEnd = 0;
+        return type == Type::TCP ? Status::ERROR : Status::UNAVAILABLE;
+    }
+    if(headerStatus == Status::UNAVAILABLE)
+        return Status::UNAVAILABLE;
+
+    if(bufferedBytes - headerSize < packetSize){
+        //Already received part is moved to buffer of packet size,
+        //rest of packet will be received straight into it
+        if(type == Type::TCP && headerSize + packetSize > SOCKET_RECEIVE_BUFFER_SIZE){
+            const size_t receivedBytes = bufferedBytes - headerSize;
+            memcpy(largePacket.grow(packetSize), packetPtr + headerSize, receivedBytes);
+            largePacket.compressed = compressed;
+            largePacketEnd = receivedBytes;
+
+            receiveBufferBegin = 0;
+            receiveBufferEnd = 0;
+        }
+
+        return Status::UNAVAILABLE;
+    }
+
+    Status status = Status::OK;
+    if(compressed){
+        //Decompressed into pooled packet, appended if caller's packet has data already
+        DataPacket compressedPacket = DataPacketPool::local().acquire();
+        memcpy(compressedPacket.grow(packetSize), packetPtr + headerSize, packetSize);
+        compressedPacket.compressed = true;
+        if(compressedPacket.decompress() == false)
+            status = type == Type::TCP ? Status::ERROR : Status::UNAVAILABLE;
+        else if(dataPacket.size() == 0)
+            std::swap(dataPacket, compressedPacket);
+        else
+            memcpy(dataPacket.grow(compressedPacket.size()), compressedPacket.data(), compressedPacket.size());
+
+        DataPacketPool::local().release(std::move(compressedPacket));
+    }
+    else if(packetSize != 0)
+        memcpy(dataPacket.grow(packetSize), packetPtr + headerSize, packetSize);
+
+    receiveBufferBegin += headerSize + packetSize;
+    if(receiveBufferBegin == receiveBufferEnd){
+        receiveBufferBegin = 0;
+        receiveBufferEnd = 0;
+    }
+
+    if(status == Status::OK)
+        countReceivedPacket(packetSize);
+    return status;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendMessage(msghdr& message, int flags, const bool continuation) {
+    //Data is sent in order, so rest of earlier DataPackets goes first
+    const Status flushStatus = flushUnsent();
+    if(flushStatus == Status::ERROR || (flushStatus == Status::UNAVAILABLE && continuation == false))
+        return flushStatus;
+    if(flushStatus == Status::UNAVAILABLE){
+        appendUnsent(message);
+        return Status::OK;
+    }
+
+    size_t remainingBytes = 0;
+    for(size_t i = 0; i < (size_t) message.msg_iovlen; i++)
+        remainingBytes += message.msg_iov[i].iov_len;
+
+    const std::uint64_t startNanoseconds = sendStartNanoseconds();
+    bool anyByteSent = false;
+    do{
+        const ssize_t sendStatus = ::sendmsg(socket_fd, &message, flags | MSG_NOSIGNAL | (mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0));
+        countSyscall();
+        if(sendStatus == -1){
+            if(errno == EINTR)
+                continue;
+
+            //Too many zero copy sends wait for completion, rest is copied
+            if(errno == ENOBUFS && (flags & MSG_ZEROCOPY) != 0){
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+
+            if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                countUnavailable();
+                if(anyByteSent == false && continuation == false)
+                    return Status::UNAVAILABLE;
+
+                //Rest of partially sent packet have to follow it, otherwise stream of packets 
+                //would be corrupted, so it waits in socket until it becomes writable
+                appendUnsent(message);
+                return Status::OK;
+            }
+
+            return Status::ERROR;
+        }
+
+        if((flags & MSG_ZEROCOPY) != 0 && sendStatus != 0)
+            zeroCopySends++;
+
+        anyByteSent = true;
+        remainingBytes -= sendStatus;
+        countSent(sendStatus, remainingBytes != 0);
+
+        skipSentBytes(message, sendStatus);
+    } while(remainingBytes != 0);
+
+    if(startNanoseconds != 0)
+        countSendTime(sendStartNanoseconds() - startNanoseconds);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::appendUnsent(const msghdr& message) {
+    for(size_t i = 0; i < (size_t) message.msg_iovlen; i++){
+        const char* data = (const char*) message.msg_iov[i].iov_base;
+        unsentBytes.insert(unsentBytes.end(), data, data + message.msg_iov[i].iov_len);
+    }
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::flushUnsent() {
+    if(unsentOffset == unsentBytes.size() && unsentFileBytes == 0)
+        return Status::OK;
+
+    while(unsentOffset != unsentBytes.size()){
+        const ssize_t sendStatus = ::send(socket_fd, unsentBytes.data() + unsentOffset, unsentBytes.size() - unsentOffset, MSG_NOSIGNAL | (mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0));
+        countSyscall();
+        if(sendStatus == -1){
+            if(errno == EINTR)
+                continue;
+
+            if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                countUnavailable();
+                return Status::UNAVAILABLE;
+            }
+
+            return Status::ERROR;
+        }
+
+        unsentOffset += sendStatus;
+        countSent(sendStatus, unsentOffset != unsentBytes.size() || unsentFileBytes != 0);
+    }
+
+    //File of 'sendFile' follows its header
+    while(unsentFileBytes != 0){
+        ssize_t sendStatus;
+        if(unsentFromPipe)
+            sendStatus = splice(unsentFile, nullptr, socket_fd, nullptr, unsentFileBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        else{
+            off_t fileOffset = unsentFileOffset;
+            sendStatus = sendfile(socket_fd, unsentFile, unsentFileOffset == -1 ? nullptr : &fileOffset, unsentFileBytes);
+            unsentFileOffset = fileOffset;
+        }
+        countSyscall();
+
+        if(sendStatus == -1){
+            if(errno == EINTR)
+                continue;
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                countUnavailable();
+                return Status::UNAVAILABLE;
+            }
+        }
+
+        //Stream can't continue with incomplete DataPacket (also when file ended earlier)
+        if(sendStatus <= 0){
+            close();
+            return Status::ERROR;
+        }
+
+        unsentFileBytes -= sendStatus;
+        countSent(sendStatus, unsentFileBytes != 0);
+    }
+
+    clearUnsent();
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::API_RESERVED::Socket::getUnsentBytes() {
+    return unsentBytes.size() - unsentOffset + unsentFileBytes;
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::clearUnsent() {
+    std::vector<char>().swap(unsentBytes);
+    unsentOffset = 0;
+    if(unsentFile != -1)
+        ::close(unsentFile);
+    unsentFile = -1;
+    unsentFileOffset = -1;
+    unsentFileBytes = 0;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::sendZeroCopyData(const void* data, const size_t dataSize, const bool afterHeader, std::uint32_t* sendId) {
+    bool zeroCopy = false;
+    for(const auto& storedOption : options){
+        if(storedOption.first == Option::ZERO_COPY)
+            zeroCopy = storedOption.second != 0;
+    }
+    //Pinning pages and waiting for completion cost more than copying small buffers.
+    //When kernel had to copy anyway, it's only slower than copying at once.
+    zeroCopy = zeroCopy && zeroCopyDeferred == false && unixDomain == false && dataSize >= ZERO_COPY_SIZE_MIN;
+
+    iovec iov;
+    iov.iov_base = (void*) data;
+    iov.iov_len = dataSize;
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    //Data have to follow already sent header, part which can't is copied to wait in socket
+    const Status status = sendMessage(message, zeroCopy ? MSG_ZEROCOPY : 0, afterHeader);
+
+    //Copied data is reusable at once, but earlier sends can still hold their buffers
+    *sendId = zeroCopySends - 1;
+    return status;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::API_RESERVED::Socket::readSendCompletions() {
+    size_t notifications = 0;
+    while(true){
+        //Extended error is followed by address of its origin
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_storage))];
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t recvStatus = recvmsg(socket_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT);
+        countSyscall();
+        if(recvStatus == -1){
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        for(cmsghdr* controlMessage = CMSG_FIRSTHDR(&message); controlMessage != nullptr; controlMessage = CMSG_NXTHDR(&message, controlMessage)){
+            if((controlMessage->cmsg_level != SOL_IP || controlMessage->cmsg_type != IP_RECVERR) && 
+               (controlMessage->cmsg_level != SOL_IPV6 || controlMessage->cmsg_type != IPV6_RECVERR))
+                continue;
+
+            sock_extended_err error;
+            memcpy(&error, CMSG_DATA(controlMessage), sizeof(error));
+            if(error.ee_errno != 0 || error.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            notifications++;
+            if((error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0)
+                zeroCopyDeferred = true;
+
+            //Range of completed sends ('ee_info' to 'ee_data'), usually following previous one
+            zeroCopyCompletedRanges.push_back(std::make_pair(error.ee_info, error.ee_data));
+            for(size_t i = 0; i < zeroCopyCompletedRanges.size(); i++){
+                const std::pair<std::uint32_t, std::uint32_t> range = zeroCopyCompletedRanges[i];
+                if(isSendBefore(zeroCopyCompleted, range.first))
+                    continue;
+
+                if(isSendBefore(range.second, zeroCopyCompleted) == false)
+                    zeroCopyCompleted = range.second + 1;
+                zeroCopyCompletedRanges.erase(zeroCopyCompletedRanges.begin() + i);
+                i = (size_t) -1;//Moved completion can join earlier ranges
+            }
+        }
+    }
+
+    return notifications;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::appendReceived(const char* data, size_t dataSize, std::vector<DataPacket>& dataPackets, size_t* receivedPackets) {
+    *receivedPackets = 0;
+    countReceived(dataSize);
+
+    //Every UDP datagram carries whole packet, 
+    //so incomplete one will never be finished
+    if(type == Type::UDP){
+        receiveBufferBegin = 0;
+        receiveBufferEnd = 0;
+    }
+
+    //Completed packets are taken out after every copy, 
+    //so next part of data always finds free space
+    while(dataSize != 0){
+        char* destination;
+        size_t copiedBytes;
+        if(largePacket.size() != 0){
+            destination = largePacket.buffer.get() + largePacketEnd;
+            copiedBytes = std::min(largePacket.size() - largePacketEnd, dataSize);
+            largePacketEnd += copiedBytes;
+        }
+        else{
+            copiedBytes = std::min(prepareReceiveBuffer(), dataSize);
+            destination = receiveBuffer.get() + receiveBufferEnd;
+            receiveBufferEnd += copiedBytes;
+        }
+
+        memcpy(destination, data, copiedBytes);
+        data += copiedBytes;
+        dataSize -= copiedBytes;
+        countBuffered();
+
+        size_t extractedPackets = 0;
+        const Status extractStatus = extractDataPackets(dataPackets, &extractedPackets);
+        *receivedPackets += extractedPackets;
+        if(extractStatus != Status::OK)
+            return extractStatus;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::extractDataPackets(std::vector<DataPacket>& dataPackets, size_t* extractedPackets) {
+    *extractedPackets = 0;
+    DataPacketPool& dataPacketPool = DataPacketPool::local();
+    while(true){
+        dataPackets.push_back(dataPacketPool.acquire());
+        const Status extractStatus = extractDataPacket(dataPackets.back());
+        if(extractStatus != Status::OK){
+            dataPacketPool.release(std::move(dataPackets.back()));
+            dataPackets.pop_back();
+            return extractStatus == Status::ERROR ? Status::ERROR : Status::OK;
+        }
+        (*extractedPackets)++;
+    }
+}
+
+
+///////////////////////////////////////////////
+size_t sj::API_RESERVED::Socket::prepareReceiveBuffer() {
+    //Packets not fitting in buffer get their own one, so at most 
+    //one incomplete packet is stored at the time
+
+    //Allocated at first receive - pages untouched by recv()
+    //are not occupying resident memory
+    if(receiveBuffer == nullptr)
+        receiveBuffer.reset(new char[SOCKET_RECEIVE_BUFFER_SIZE]);
+
+    //Move incomplete packet to the front, to make place for the rest of it
+    if(receiveBufferBegin != 0){
+        memmove(receiveBuffer.get(), receiveBuffer.get() + receiveBufferBegin, receiveBufferEnd - receiveBufferBegin);
+        receiveBufferEnd -= receiveBufferBegin;
+        receiveBufferBegin = 0;
+    }
+
+    return SOCKET_RECEIVE_BUFFER_SIZE - receiveBufferEnd;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::API_RESERVED::Socket::fillReceiveBuffer() {
+    //Large packet is received straight into its own buffer, 
+    //reading never goes past its end
+    const bool intoLargePacket = largePacket.size() != 0;
+    char* const destination = intoLargePacket ? largePacket.buffer.get() + largePacketEnd : nullptr;
+    const size_t freeBytes = intoLargePacket ? largePacket.size() - largePacketEnd : prepareReceiveBuffer();
+
+    size_t readedBytes = 0;
+    Status status;
+    if(type == Type::UDP && receiveOffload && unixDomain == false){
+        //Joined datagrams make the same stream of packets as TCP, 
+        //when those not carrying exactly one packet are removed
+        char* const datagramsPtr = receiveBuffer.get() + receiveBufferEnd;
+        size_t segmentSize;
+        status = receiveSegmentsInto(datagramsPtr, freeBytes, &readedBytes, &segmentSize);
+        if(status == Status::OK)
+            readedBytes = removeInvalidDatagrams(datagramsPtr, readedBytes, segmentSize);
+    }
+    else
+        status = receiveInto(intoLargePacket ? destination : receiveBuffer.get() + receiveBufferEnd, freeBytes, &readedBytes);
+    if(status != Status::OK)
+        return status;
+
+    //Connection closed by peer
+    if(type == Type::TCP && readedBytes == 0)
+        return Status::ERROR;
+
+    if(intoLargePacket)
+        largePacketEnd += readedBytes;
+    else
+        receiveBufferEnd += readedBytes;
+
+    countBuffered();
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::API_RESERVED::Socket::getStats() {
+    SocketStats stats = SocketStats();
+    stats.counters.bytesSent = counters.bytesSent.load(std::memory_order_relaxed);
+    stats.counters.bytesReceived = counters.bytesReceived.load(std::memory_order_relaxed);
+    stats.counters.packetsSent = counters.packetsSent.load(std::memory_order_relaxed);
+    stats.counters.packetsReceived = counters.packetsReceived.load(std::memory_order_relaxed);
+    stats.counters.syscalls = counters.syscalls.load(std::memory_order_relaxed);
+    stats.counters.unavailable = counters.unavailable.load(std::memory_order_relaxed);
+    stats.counters.partialSends = counters.partialSends.load(std::memory_order_relaxed);
+    stats.counters.receiveBufferHighWater = counters.receiveBufferHighWater.load(std::memory_order_relaxed);
+
+    const AtomicHistogram* const histograms[] = {sentPacketSizes.load(std::memory_order_acquire), receivedPacketSizes.load(std::memory_order_acquire), 
+                                                 sendNanoseconds.load(std::memory_order_acquire)};
+    Histogram* const snapshots[] = {&stats.sentPacketSizes, &stats.receivedPacketSizes, &stats.sendNanoseconds};
+    for(size_t i = 0; i < 3; i++){
+        if(histograms[i] != nullptr)
+            histograms[i]->snapshot(*snapshots[i]);
+    }
+
+    return stats;
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::gatherAcceptedStats() {
+    if(acceptedStats == nullptr)
+        acceptedStats = std::make_shared<SharedStats>();
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::API_RESERVED::Socket::getAcceptedStats() {
+    if(acceptedStats == nullptr)
+        return SocketStats();
+
+    return acceptedStats->snapshot();
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countSent(const size_t bytes, const bool partial) {
+    counters.bytesSent.fetch_add(bytes, std::memory_order_relaxed);
+    if(partial)
+        counters.partialSends.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countSentPacket(const size_t packetSize) {
+    counters.packetsSent.fetch_add(1, std::memory_order_relaxed);
+    recordHistogram(sentPacketSizes, &SharedStats::sentPacketSizes, listenerStats.get(), packetSize);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countSendTime(const std::uint64_t nanoseconds) {
+    recordHistogram(sendNanoseconds, &SharedStats::sendNanoseconds, listenerStats.get(), nanoseconds);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countSyscall() {
+    const std::uint64_t syscalls = counters.syscalls.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(syscalls - flushedCounters.syscalls.load(std::memory_order_relaxed) >= STATS_FLUSH_SYSCALLS)
+        flushStats();
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countUnavailable() {
+    counters.unavailable.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countReceived(const size_t bytes) {
+    counters.bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countReceivedPacket(const size_t packetSize) {
+    counters.packetsReceived.fetch_add(1, std::memory_order_relaxed);
+    recordHistogram(receivedPacketSizes, &SharedStats::receivedPacketSizes, listenerStats.get(), packetSize);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::countBuffered() {
+    const size_t bufferedBytes = std::max(receiveBufferEnd - receiveBufferBegin, largePacketEnd);
+    storeMax(counters.receiveBufferHighWater, bufferedBytes);
+}
+
+
+///////////////////////////////////////////////
+void sj::API_RESERVED::Socket::flushStats() {
+    //Sending and receiving thread can flush at once, parts can be added in any order (even 
+    //as negative differences), but they always sum up to counters
+    SocketCounters unflushed;
+    unflushed.bytesSent = takeUnflushed(counters.bytesSent, flushedCounters.bytesSent);
+    unflushed.bytesReceived = takeUnflushed(counters.bytesReceived, flushedCounters.bytesReceived);
+    unflushed.packetsSent = takeUnflushed(counters.packetsSent, flushedCounters.packetsSent);
+    unflushed.packetsReceived = takeUnflushed(counters.packetsReceived, flushedCounters.packetsReceived);
+    unflushed.syscalls = takeUnflushed(counters.syscalls, flushedCounters.syscalls);
+    unflushed.unavailable = takeUnflushed(counters.unavailable, flushedCounters.unavailable);
+    unflushed.partialSends = takeUnflushed(counters.partialSends, flushedCounters.partialSends);
+    unflushed.receiveBufferHighWater = counters.receiveBufferHighWater.load(std::memory_order_relaxed);
+
+    processStats().add(unflushed);
+    if(listenerStats != nullptr)
+        listenerStats->add(unflushed);
+}
+
+
+///////////////////////////////////////////////
+//  TCPClientSocket Class
+///////////////////////////////////////////////
+sj::TCPClientSocket::TCPClientSocket(const Mode mode) 
+    : socket(mode), connecting(false), connectDeadline(0) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::TCPClientSocket::~TCPClientSocket() {
+    disconnect();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::connect(const std::string& ipAddress, const short port) {
+    return connect(Endpoint(ipAddress, port));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::connect(const Endpoint& server) {
+    return connect(server, -1);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::connect(const Endpoint& server, const int timeoutMs) {
+    //Repeated call checks connection started before
+    if(connecting)
+        return finishConnect(0);
+
+    if(isConnected() || server.isValid() == false)
+        return Status::ERROR;
+
+    if(socket.getMode() == Mode::BLOCKING && timeoutMs < 0){
+        if(socket.create(Socket::Type::TCP, server.isUnix()) == -1)
+            return Status::ERROR;
+
+        if(socket.connect(server) == -1){
+            socket.close();
+            return Status::ERROR;
+        }
+
+        return Status::OK;
+    }
+
+    const Status status = beginConnect(server, timeoutMs);
+    if(status != Status::UNAVAILABLE || socket.getMode() == Mode::NON_BLOCKING)
+        return status;
+
+    return finishConnect(timeoutMs);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::connect(const std::vector<TCPClientSocket*>& clientSockets, const std::vector<Endpoint>& servers, const int timeoutMs, size_t* connectedSockets) {
+    *connectedSockets = 0;
+    if(servers.size() != 1 && servers.size() != clientSockets.size())
+        return Status::ERROR;
+
+    //Every handshake is started before waiting for any of them
+    std::vector<pollfd> pendingFDs;
+    std::vector<TCPClientSocket*> pendingSockets;
+    for(size_t i = 0; i < clientSockets.size(); i++){
+        TCPClientSocket& clientSocket = *clientSockets[i];
+        const Endpoint& server = servers[servers.size() == 1 ? 0 : i];
+        if(clientSocket.isConnected() || clientSocket.isConnecting() || server.isValid() == false)
+            continue;
+
+        const Status status = clientSocket.beginConnect(server, timeoutMs);
+        if(status == Status::OK)
+            (*connectedSockets)++;
+        else if(status == Status::UNAVAILABLE){
+            pollfd pendingFD = {clientSocket.socket.getFD(), POLLOUT, 0};
+            pendingFDs.push_back(pendingFD);
+            pendingSockets.push_back(&clientSocket);
+        }
+    }
+
+    const std::uint64_t deadline = timeoutMs < 0 ? 0 : monotonicNanoseconds() + (std::uint64_t) timeoutMs * 1000000;
+    while(pendingFDs.empty() == false){
+        const int readyCount = ::poll(pendingFDs.data(), pendingFDs.size(), remainingMilliseconds(deadline));
+        if(readyCount == -1 && errno != EINTR)
+            break;
+        if(readyCount == 0)//Timed out
+            break;
+
+        size_t stillPending = 0;
+        for(size_t i = 0; i < pendingFDs.size(); i++){
+            if(pendingFDs[i].revents != 0){
+                const Status status = pendingSockets[i]->finishConnect(0);
+                if(status == Status::OK)
+                    (*connectedSockets)++;
+                if(status != Status::UNAVAILABLE)
+                    continue;
+            }
+
+            pendingFDs[stillPending] = pendingFDs[i];
+            pendingSockets[stillPending] = pendingSockets[i];
+            stillPending++;
+        }
+        pendingFDs.resize(stillPending);
+        pendingSockets.resize(stillPending);
+    }
+
+    for(TCPClientSocket* pendingSocket : pendingSockets)
+        pendingSocket->disconnect();
+
+    return *connectedSockets == clientSockets.size() ? Status::OK : Status::ERROR;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::disconnect() {
+    if(connecting){
+        connecting = false;
+        return socket.close() == -1 ? Status::ERROR : Status::OK;
+    }
+
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    Status returnStatus = Status::OK;
+    
+    if(shutdown(socket.getFD(), SHUT_RDWR) == -1)
+        returnStatus = Status::ERROR;
+
+    if(socket.close() == -1)
+        returnStatus = Status::ERROR;
+
+    return returnStatus;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::send(DataPacket& dataPacket) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(dataPacket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::send(std::vector<DataPacket>& dataPackets) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(dataPackets.data(), dataPackets.size());
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::send(const void* data, const size_t dataSize) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(data, dataSize);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::sendFile(const int fd, const std::int64_t offset, const size_t length) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    size_t sentBytes;
+    return socket.sendFile(fd, offset, length, true, &sentBytes);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::sendFile(const int fd, const std::int64_t offset, const size_t length, size_t* sentBytes) {
+    *sentBytes = 0;
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendFile(fd, offset, length, false, sentBytes);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::sendZeroCopy(DataPacket& dataPacket, std::uint32_t* sendId) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendZeroCopy(dataPacket, sendId);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::sendZeroCopy(const void* data, const size_t dataSize, std::uint32_t* sendId) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.sendZeroCopy(data, dataSize, sendId);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::flush() {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.flushUnsent();
+}
+
+
+///////////////////////////////////////////////
+size_t sj::TCPClientSocket::getUnsentBytes() {
+    return socket.getUnsentBytes();
+}
+
+
+///////////////////////////////////////////////
+bool sj::TCPClientSocket::isSendCompleted(const std::uint32_t sendId) {
+    return socket.isSendCompleted(sendId);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::waitForSendCompletion(const std::uint32_t sendId, const int timeoutMs) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.waitForSendCompletion(sendId, timeoutMs);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::receiveInto(DataPacket& dataPacket) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.receiveInto(dataPacket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets) {
+    if(isConnected() == false){
+        *receivedPackets = 0;
+        return Status::ERROR;
+    }
+
+    return socket.receiveInto(dataPackets, receivedPackets);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
+    if(isConnected() == false)
+        return Status::ERROR;
+
+    return socket.receiveInto(buffer, bufferSize, readedBytes);
+}
+
+
+///////////////////////////////////////////////
+bool sj::TCPClientSocket::isConnected() {
+    return socket.getFD() != -1 && connecting == false;
+}
+
+
+///////////////////////////////////////////////
+bool sj::TCPClientSocket::isConnecting() {
+    return connecting;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::setOption(const Option option, const int value) {
+    return socket.setOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::getOption(const Option option, int* value) {
+    return socket.getOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::TCPClientSocket::getStats() {
+    return socket.getStats();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::beginConnect(const Endpoint& server, const int timeoutMs) {
+    if(socket.create(Socket::Type::TCP, server.isUnix()) == -1)
+        return Status::ERROR;
+
+    //Socket stays non-blocking until handshake is finished
+    if(setNonBlocking(socket.getFD(), true) == false){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    connecting = true;
+    connectDeadline = timeoutMs < 0 ? 0 : monotonicNanoseconds() + (std::uint64_t) timeoutMs * 1000000;
+    if(socket.connect(server) == 0)//Possible on loopback
+        return finishConnect(0);
+
+    if(errno != EINPROGRESS){
+        connecting = false;
+        socket.close();
+        return Status::ERROR;
+    }
+
+    return Status::UNAVAILABLE;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPClientSocket::finishConnect(const int waitMs) {
+    pollfd connected = {socket.getFD(), POLLOUT, 0};
+    int pollStatus;
+    do{
+        const int remainingMs = remainingMilliseconds(connectDeadline);
+        pollStatus = ::poll(&connected, 1, remainingMs != -1 && (waitMs == -1 || remainingMs < waitMs) ? remainingMs : waitMs);
+    } while(pollStatus == -1 && errno == EINTR);
+
+    if(pollStatus == 0){
+        if(connectDeadline == 0 || monotonicNanoseconds() < connectDeadline)
+            return Status::UNAVAILABLE;
+
+        pollStatus = -1;//Timed out
+    }
+
+    //Result of handshake is reported as pending error of socket
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    connecting = false;
+    if(pollStatus == -1 || getsockopt(socket.getFD(), SOL_SOCKET, SO_ERROR, &error, &errorSize) == -1 || error != 0 ||
+       (socket.getMode() == Mode::BLOCKING && setNonBlocking(socket.getFD(), false) == false)){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+//  TCPListenSocket Class
+///////////////////////////////////////////////
+sj::TCPListenSocket::TCPListenSocket(const Mode mode) 
+    : socket(mode) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::TCPListenSocket::~TCPListenSocket() {
+    endListening();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::beginListening(const short port) {
+    const int maxListenConnections = SOMAXCONN;//128
+    return beginListening(port, maxListenConnections, false);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::beginListening(const short port, const int backlog, const bool reusePort) {
+    return beginListening(Endpoint("0.0.0.0", port), backlog, reusePort);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::beginListening(const Endpoint& local, const int backlog, const bool reusePort) {
+    if(isListening() || local.isValid() == false)
+        return Status::ERROR;
+
+    if(socket.create(Socket::Type::TCP, local.isUnix()) == -1) 
+        return Status::ERROR;
+
+    //Has to be set before bind
+    if(reusePort && socket.setOption(SOL_SOCKET, SO_REUSEPORT, 1) == -1){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    if(socket.bind(local) == -1){
+        socket.close();
+        return Status::ERROR;
+    }
+    
+    if(listen(socket.getFD(), backlog) == -1){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    //Otherwise accept waits for client even in NON_BLOCKING Mode
+    if(socket.getMode() == Mode::NON_BLOCKING && setNonBlocking(socket.getFD(), true) == false){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    socket.gatherAcceptedStats();
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::endListening() {
+    if(isListening() == false)
+        return Status::ERROR;
+
+    Status returnStatus = Status::OK;
+    
+    if(::shutdown(socket.getFD(), SHUT_RDWR) == -1)
+        returnStatus = Status::ERROR;
+
+    if(socket.close() == -1)
+        returnStatus = Status::ERROR;
+
+    return returnStatus;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::acceptNewClient(TCPClientSocket& newClient) {
+    if(isListening() == false || newClient.isConnected() || newClient.isConnecting())
+        return Status::ERROR;
+
+    Mode mode = socket.getMode();
+    const int acceptStatus = accept4(socket.getFD(), NULL, NULL, mode == Mode::NON_BLOCKING ? SOCK_NONBLOCK : 0);
+
+    if(acceptStatus == -1){
+        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return Status::UNAVAILABLE;
+
+        return Status::ERROR;
+    }
+
+    newClient.socket.asignFD(acceptStatus);
+    if(newClient.socket.inheritFrom(socket) != Status::OK){
+        newClient.socket.close();
+        return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+bool sj::TCPListenSocket::isListening() {
+    return socket.getFD() != -1;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::setOption(const Option option, const int value) {
+    return socket.setOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPListenSocket::getOption(const Option option, int* value) {
+    return socket.getOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::TCPListenSocket::getStats() {
+    return socket.getAcceptedStats();
+}
+
+
+///////////////////////////////////////////////
+//  TCPShardedListenSocket Class
+///////////////////////////////////////////////
+sj::TCPShardedListenSocket::TCPShardedListenSocket(const Mode mode, const size_t shardsCount) {
+    for(size_t i = 0; i < shardsCount; i++)
+        shards.emplace_back(new TCPListenSocket(mode));
+}
+
+
+///////////////////////////////////////////////
+sj::TCPShardedListenSocket::~TCPShardedListenSocket() {
+    endListening();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPShardedListenSocket::beginListening(const short port, const int backlog) {
+    if(shards.empty() || isListening())
+        return Status::ERROR;
+
+    for(auto& shard : shards){
+        if(shard->beginListening(port, backlog, true) != Status::OK){
+            endListening();
+            return Status::ERROR;
+        }
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPShardedListenSocket::endListening() {
+    if(isListening() == false)
+        return Status::ERROR;
+
+    Status returnStatus = Status::OK;
+    for(auto& shard : shards){
+        if(shard->isListening() && shard->endListening() != Status::OK)
+            returnStatus = Status::ERROR;
+    }
+
+    return returnStatus;
+}
+
+
+///////////////////////////////////////////////
+size_t sj::TCPShardedListenSocket::getShardsCount() {
+    return shards.size();
+}
+
+
+///////////////////////////////////////////////
+sj::TCPListenSocket& sj::TCPShardedListenSocket::getShard(const size_t shard) {
+    return *shards[shard];
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::TCPShardedListenSocket::pinShard(const size_t shard, const int cpu) {
+    if(shard >= shards.size() || cpu < 0 || cpu >= CPU_SETSIZE || shards[shard]->isListening() == false)
+        return Status::ERROR;
+
+    //Kernel picks listener whose incoming CPU matches CPU handling the connection
+    if(shards[shard]->socket.setOption(SOL_SOCKET, SO_INCOMING_CPU, cpu) == -1)
+        return Status::ERROR;
+
+    if(pinCurrentThread(cpu) == false)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+bool sj::TCPShardedListenSocket::isListening() {
+    for(auto& shard : shards){
+        if(shard->isListening())
+            return true;
+    }
+
+    return false;
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::TCPShardedListenSocket::getStats() {
+    SocketStats stats = SocketStats();
+    for(auto& shard : shards){
+        const SocketStats shardStats = shard->getStats();
+        stats.counters.bytesSent += shardStats.counters.bytesSent;
+        stats.counters.bytesReceived += shardStats.counters.bytesReceived;
+        stats.counters.packetsSent += shardStats.counters.packetsSent;
+        stats.counters.packetsReceived += shardStats.counters.packetsReceived;
+        stats.counters.syscalls += shardStats.counters.syscalls;
+        stats.counters.unavailable += shardStats.counters.unavailable;
+        stats.counters.partialSends += shardStats.counters.partialSends;
+        stats.counters.receiveBufferHighWater = std::max(stats.counters.receiveBufferHighWater, shardStats.counters.receiveBufferHighWater);
+        stats.sentPacketSizes.add(shardStats.sentPacketSizes);
+        stats.receivedPacketSizes.add(shardStats.receivedPacketSizes);
+        stats.sendNanoseconds.add(shardStats.sendNanoseconds);
+    }
+
+    return stats;
+}
+
+
+///////////////////////////////////////////////
+//  UDPSocket Class
+///////////////////////////////////////////////
+sj::UDPSocket::UDPSocket(const Mode mode) 
+    : socket(mode) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::UDPSocket::~UDPSocket() {
+    unbind();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::bind(const short port) {
+    return bind(Endpoint("0.0.0.0", port));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::bind(const Endpoint& local) {
+    if(isBinded() || local.isValid() == false)
+        return Status::ERROR;
+
+    if(socket.create(Socket::Type::UDP, local.isUnix()) == -1) 
+        return Status::ERROR;
+
+    if(socket.bind(local) == -1){
+        socket.close();
+        return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::unbind() {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    if(socket.close())
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::connect(const Endpoint& receiver) {
+    if(isBinded() == false || receiver.isValid() == false)
+        return Status::ERROR;
+
+    if(socket.connect(receiver) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::disconnect() {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    //AF_UNSPEC address dissolves association with receiver
+    sockaddr unspecifiedAddr;
+    memset(&unspecifiedAddr, 0, sizeof(unspecifiedAddr));
+    unspecifiedAddr.sa_family = AF_UNSPEC;
+    if(::connect(socket.getFD(), &unspecifiedAddr, sizeof(unspecifiedAddr)) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::send(DataPacket& dataPacket) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(dataPacket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::send(const void* data, const size_t dataSize) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(data, dataSize);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendTo(DataPacket& dataPacket, const std::string& ipAddress, const short port) {
+    return sendTo(dataPacket, Endpoint(ipAddress, port));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendTo(DataPacket& dataPacket, const Endpoint& receiver) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(dataPacket, &receiver);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendTo(const void* data, const size_t dataSize, const std::string& ipAddress, const short port) {
+    return sendTo(data, dataSize, Endpoint(ipAddress, port));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendTo(const void* data, const size_t dataSize, const Endpoint& receiver) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendTo(data, dataSize, &receiver);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::receiveInto(DataPacket& dataPacket) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.receiveInto(dataPacket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.receiveInto(buffer, bufferSize, readedBytes);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendBatch(std::vector<DataPacket>& dataPackets, const std::vector<Endpoint>& receivers, size_t* sentPackets) {
+    if(isBinded() == false){
+        *sentPackets = 0;
+        return Status::ERROR;
+    }
+
+    return socket.sendBatch(dataPackets.data(), dataPackets.size(), receivers.data(), receivers.size(), sentPackets);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendBatch(std::vector<DataPacket>& dataPackets, const Endpoint& receiver, size_t* sentPackets) {
+    if(isBinded() == false){
+        *sentPackets = 0;
+        return Status::ERROR;
+    }
+
+    return socket.sendBatch(dataPackets.data(), dataPackets.size(), &receiver, 1, sentPackets);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendSegments(const void* data, const size_t dataSize, const size_t segmentSize) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendSegments(data, dataSize, segmentSize, nullptr);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::sendSegmentsTo(const void* data, const size_t dataSize, const size_t segmentSize, const Endpoint& receiver) {
+    if(isBinded() == false)
+        return Status::ERROR;
+
+    return socket.sendSegments(data, dataSize, segmentSize, &receiver);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::receiveSegmentsInto(void* buffer, const size_t bufferSize, size_t* readedBytes, size_t* segmentSize) {
+    if(isBinded() == false){
+        *readedBytes = 0;
+        *segmentSize = 0;
+        return Status::ERROR;
+    }
+
+    return socket.receiveSegmentsInto(buffer, bufferSize, readedBytes, segmentSize);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::receiveBatch(std::vector<DataPacket>& dataPackets, const size_t maxPackets, size_t* receivedPackets, std::vector<Endpoint>* senders) {
+    if(isBinded() == false){
+        *receivedPackets = 0;
+        return Status::ERROR;
+    }
+
+    return socket.receiveBatch(dataPackets, maxPackets, receivedPackets, senders);
+}
+
+
+///////////////////////////////////////////////
+bool sj::UDPSocket::isBinded() {
+    return socket.getFD() != -1;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::setOption(const Option option, const int value) {
+    return socket.setOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::getOption(const Option option, int* value) {
+    return socket.getOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::UDPSocket::getStats() {
+    return socket.getStats();
+}
+
+
+//Sets interface of multicast request from its IP address or name, empty leaves it to kernel
+static bool parseInterface(const std::string& interface, ip_mreqn& request) {
+    request.imr_address.s_addr = htonl(INADDR_ANY);
+    request.imr_ifindex = 0;
+    if(interface.empty())
+        return true;
+
+    if(inet_pton(AF_INET, interface.c_str(), &request.imr_address) == 1)
+        return true;
+
+    request.imr_ifindex = if_nametoindex(interface.c_str());
+    return request.imr_ifindex != 0;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::joinGroup(const std::string& groupAddress, const std::string& interface) {
+    return setMembership(groupAddress, interface, true);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::leaveGroup(const std::string& groupAddress, const std::string& interface) {
+    return setMembership(groupAddress, interface, false);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::setMulticastInterface(const std::string& interface) {
+    ip_mreqn request;
+    std::memset(&request, 0, sizeof(request));
+    if(isBinded() == false || parseInterface(interface, request) == false)
+        return Status::ERROR;
+
+    if(::setsockopt(socket.getFD(), IPPROTO_IP, IP_MULTICAST_IF, &request, sizeof(request)) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::UDPSocket::setMembership(const std::string& groupAddress, const std::string& interface, const bool join) {
+    ip_mreqn request;
+    std::memset(&request, 0, sizeof(request));
+    if(isBinded() == false || parseInterface(interface, request) == false)
+        return Status::ERROR;
+
+    if(inet_pton(AF_INET, groupAddress.c_str(), &request.imr_multiaddr) != 1 || IN_MULTICAST(ntohl(request.imr_multiaddr.s_addr)) == false)
+        return Status::ERROR;
+
+    //By default Linux delivers datagrams of groups joined by any socket on the host to every socket bound to their port
+    const int allGroups = 0;
+    if(join && ::setsockopt(socket.getFD(), IPPROTO_IP, IP_MULTICAST_ALL, &allGroups, sizeof(allGroups)) == -1)
+        return Status::ERROR;
+
+    if(::setsockopt(socket.getFD(), IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, &request, sizeof(request)) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+//  MulticastPublisher Class
+///////////////////////////////////////////////
+sj::MulticastPublisher::MulticastPublisher(const Mode mode) 
+    : udpSocket(mode) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::MulticastPublisher::~MulticastPublisher() {
+
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::open(const Endpoint& group, const std::string& interface) {
+    in_addr groupAddress;
+    if(isOpen() || group.isValid() == false || group.isUnix() == true)
+        return Status::ERROR;
+
+    if(inet_pton(AF_INET, group.getIPAddress().c_str(), &groupAddress) != 1 || IN_MULTICAST(ntohl(groupAddress.s_addr)) == false)
+        return Status::ERROR;
+
+    //Connected socket skips address handling on every send
+    if(udpSocket.bind(0) != Status::OK)
+        return Status::ERROR;
+
+    if((interface.empty() == false && udpSocket.setMulticastInterface(interface) != Status::OK) || udpSocket.connect(group) != Status::OK){
+        udpSocket.unbind();
+        return Status::ERROR;
+    }
+
+    this->group = group;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::close() {
+    return udpSocket.unbind();
+}
+
+
+///////////////////////////////////////////////
+bool sj::MulticastPublisher::isOpen() {
+    return udpSocket.isBinded();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::publish(DataPacket& dataPacket) {
+    return udpSocket.send(dataPacket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::publish(std::vector<DataPacket>& dataPackets, size_t* sentPackets) {
+    return udpSocket.sendBatch(dataPackets, group, sentPackets);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::setOption(const Option option, const int value) {
+    return udpSocket.setOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::MulticastPublisher::getOption(const Option option, int* value) {
+    return udpSocket.getOption(option, value);
+}
+
+
+///////////////////////////////////////////////
+sj::SocketStats sj::MulticastPublisher::getStats() {
+    return udpSocket.getStats();
+}
+
+
+///////////////////////////////////////////////
+//  ReliableUDPSocket Class
+///////////////////////////////////////////////
+//Datagram: version, flags, session, packet number (lower 32 bits), acknowledgement when flagged,
+//then frames: stream, flags (Delivery and compression), sequence in stream, length prefixed message.
+
+//Message waiting for its first send, or reliable one waiting for acknowledgement
+struct sj::ReliableUDPSocket::Message{
+    DataPacket dataPacket;
+    std::uint64_t id;
+    std::uint64_t packetNumber;//Last datagram carrying message
+    std::uint32_t sequence;//Number in its stream
+    std::uint8_t stream;
+    Delivery delivery;
+    bool queued;//Declared lost and waiting in 'retransmissions'
+};
+
+
+//Ack-eliciting datagram not acknowledged nor declared lost yet
+struct sj::ReliableUDPSocket::SentPacket{
+    std::uint64_t sentTime;
+    size_t size;
+    std::vector<std::uint64_t> messageIDs;//Reliable messages carried
+};
+
+
+//Sending side of one reliable stream. Receiver drops messages too far after its first 
+//missing one, so stream can't run ahead of its oldest unacknowledged message.
+struct sj::ReliableUDPSocket::SendStream{
+    std::deque<std::pair<std::uint64_t, std::uint32_t>> outstanding;//ID and sequence of messages, oldest first, acknowledged ones are removed lazily
+};
+
+
+//Receiving side of one stream
+struct sj::ReliableUDPSocket::ReceiveStream{
+    std::uint32_t nextSequence;//First reliable message not delivered yet
+    std::deque<std::pair<bool, DataPacket>> window;//Messages from 'nextSequence' on, flag is set for received ones
+    bool latestDelivered;
+    std::uint32_t latestSequence;//Newest message delivered by LATEST_ONLY
+};
+
+
+//Full number closest to 'expected' with given lower 32 bits
+static std::uint64_t expandNumber(const std::uint32_t truncated, const std::uint64_t expected) {
+    const std::uint64_t window = 1ull << 32;
+    std::uint64_t candidate = (expected & ~(window - 1)) | truncated;
+    if(candidate + window / 2 <= expected && candidate <= UINT64_MAX - window)
+        candidate += window;
+    else if(candidate > expected + window / 2 && candidate >= window)
+        candidate -= window;
+
+    return candidate;
+}
+
+
+//splitmix64, deterministic for LinkSimulation seed
+static std::uint64_t nextRandom(std::uint64_t& state) {
+    std::uint64_t value = (state += 0x9E3779B97F4A7C15ull);
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+
+///////////////////////////////////////////////
+sj::ReliableUDPSocket::ReliableUDPSocket(const Mode mode)
+    : mode(mode), udpSocket(Mode::NON_BLOCKING), connected(false), session(0), peerSession(0), previousPeerSession(0),
+      nextMessageID(0), nextPacketNumber(1), linkSimulation{0.0, 0, 0, 0}, randomState(0) {
+    std::memset(&stats, 0, sizeof(stats));
+    for(size_t i = 0; i < 256; i++){
+        deliveries[i] = Delivery::RELIABLE_ORDERED;
+        sendSequences[i] = 0;
+    }
+
+    std::random_device randomDevice;
+    while(session == 0)
+        session = randomDevice();
+
+    resetConnection();
+}
+
+
+///////////////////////////////////////////////
+sj::ReliableUDPSocket::~ReliableUDPSocket() {
+
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::bind(const short port) {
+    return udpSocket.bind(port);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::bind(const Endpoint& local) {
+    return udpSocket.bind(local);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::connect(const Endpoint& peer) {
+    if(connected == true)
+        return Status::ERROR;
+
+    if(udpSocket.connect(peer) != Status::OK)
+        return Status::ERROR;
+
+    connected = true;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::disconnect() {
+    if(connected == true)
+        udpSocket.disconnect();
+
+    connected = false;
+    sendQueue.clear();
+    receivedMessages.clear();
+    resetConnection();
+
+    //Peer sees new session and starts over too
+    std::random_device randomDevice;
+    const std::uint32_t oldSession = session;
+    while(session == 0 || session == oldSession)
+        session = randomDevice();
+
+    peerSession = 0;
+    previousPeerSession = 0;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+bool sj::ReliableUDPSocket::isConnected() {
+    return connected;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::setDelivery(const std::uint8_t stream, const Delivery delivery) {
+    //Receiver keeps one sequence per stream, so Delivery can't change in the middle of it
+    if(sendSequences[stream] != 0)
+        return Status::ERROR;
+
+    deliveries[stream] = delivery;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::send(DataPacket& dataPacket, const std::uint8_t stream) {
+    if(connected == false || dataPacket.size() > RELIABLE_MESSAGE_SIZE_MAX)
+        return Status::ERROR;
+
+    if(isSendBlocked(stream)){
+        if(update() != Status::OK)
+            return Status::ERROR;
+
+        while(isSendBlocked(stream)){
+            if(mode == Mode::NON_BLOCKING)
+                return Status::UNAVAILABLE;
+
+            if(waitForEvents(getTimeoutMs()) != Status::OK || update() != Status::OK)
+                return Status::ERROR;
+        }
+    }
+
+    const Delivery delivery = deliveries[stream];
+    if(delivery == Delivery::LATEST_ONLY){
+        //Older message of the stream which is still queued is replaced, keeping its place in queue
+        for(std::unique_ptr<Message>& message : sendQueue){
+            if(message->stream == stream){
+                message->dataPacket = dataPacket;
+                message->sequence = sendSequences[stream]++;
+                stats.messagesSent++;
+                return Status::OK;
+            }
+        }
+    }
+
+    std::unique_ptr<Message> message(new Message());
+    message->dataPacket = dataPacket;
+    message->id = nextMessageID++;
+    message->packetNumber = 0;
+    message->sequence = sendSequences[stream]++;
+    message->stream = stream;
+    message->delivery = delivery;
+    message->queued = false;
+    if(delivery == Delivery::RELIABLE_ORDERED){
+        if(sendStreams[stream] == nullptr)
+            sendStreams[stream].reset(new SendStream());
+        sendStreams[stream]->outstanding.emplace_back(message->id, message->sequence);
+    }
+    sendQueue.push_back(std::move(message));
+    stats.messagesSent++;
+
+    sendDatagrams(monotonicNanoseconds());
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::receiveInto(DataPacket& dataPacket, std::uint8_t* stream) {
+    while(true){
+        if(receivedMessages.empty() == false){
+            if(stream != nullptr)
+                *stream = receivedMessages.front().first;
+
+            dataPacket = std::move(receivedMessages.front().second);
+            receivedMessages.pop_front();
+            return Status::OK;
+        }
+
+        if(update() != Status::OK)
+            return Status::ERROR;
+
+        if(receivedMessages.empty() == false)
+            continue;
+
+        if(mode == Mode::NON_BLOCKING)
+            return Status::UNAVAILABLE;
+
+        if(waitForEvents(getTimeoutMs()) != Status::OK)
+            return Status::ERROR;
+    }
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::update() {
+    if(udpSocket.isBinded() == false)
+        return Status::ERROR;
+
+    const std::uint64_t now = monotonicNanoseconds();
+    receiveDatagrams(now);
+
+    if(lossTime != 0 && now >= lossTime){
+        detectLostPackets(now);
+    }
+    else if(sentPackets.empty() == false && now >= getProbeDeadline()){
+        //Nothing was acknowledged for too long, oldest messages are resent even over congestion window
+        probeTimeouts++;
+        probes = 2;
+        const std::map<std::uint64_t, std::unique_ptr<SentPacket>>::iterator oldest = sentPackets.begin();
+        for(const std::uint64_t messageID : oldest->second->messageIDs)
+            requeue(messageID, oldest->first);
+    }
+
+    while(delayedDatagrams.empty() == false && delayedDatagrams.begin()->first <= now){
+        udpSocket.send(delayedDatagrams.begin()->second);
+        DataPacketPool::local().release(std::move(delayedDatagrams.begin()->second));
+        delayedDatagrams.erase(delayedDatagrams.begin());
+    }
+
+    sendDatagrams(now);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+int sj::ReliableUDPSocket::getTimeoutMs() {
+    return remainingMilliseconds(getNextDeadline());
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::flush(const int timeoutMs) {
+    const std::uint64_t deadline = timeoutMs >= 0 ? monotonicNanoseconds() + (std::uint64_t) timeoutMs * 1000000 : 0;
+    while(true){
+        if(update() != Status::OK)
+            return Status::ERROR;
+
+        if(sendQueue.empty() && unacknowledged.empty())
+            return Status::OK;
+
+        if(connected == false)
+            return Status::ERROR;
+
+        const int remainingMs = remainingMilliseconds(deadline);
+        if(remainingMs == 0)
+            return Status::UNAVAILABLE;
+
+        int waitMs = getTimeoutMs();
+        if(remainingMs != -1 && (waitMs == -1 || remainingMs < waitMs))
+            waitMs = remainingMs;
+
+        if(waitForEvents(waitMs) != Status::OK)
+            return Status::ERROR;
+    }
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::setLinkSimulation(const LinkSimulation& linkSimulation) {
+    this->linkSimulation = linkSimulation;
+    randomState = linkSimulation.seed;
+}
+
+
+///////////////////////////////////////////////
+sj::ReliableStats sj::ReliableUDPSocket::getStats() {
+    ReliableStats result = stats;
+    result.smoothedRttNanoseconds = minRtt != 0 ? smoothedRtt : 0;
+    result.rttVariationNanoseconds = minRtt != 0 ? rttVariation : 0;
+    result.minRttNanoseconds = minRtt;
+    result.congestionWindow = congestionWindow;
+    result.bytesInFlight = bytesInFlight;
+    result.pendingMessages = sendQueue.size() + unacknowledged.size();
+    return result;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::resetConnection() {
+    unacknowledged.clear();
+    retransmissions.clear();
+    sentPackets.clear();
+    delayedDatagrams.clear();
+    for(size_t i = 0; i < 256; i++){
+        sendSequences[i] = 0;
+        receiveStreams[i].reset();
+        if(sendStreams[i] != nullptr)
+            sendStreams[i]->outstanding.clear();
+    }
+    for(std::unique_ptr<Message>& message : sendQueue){
+        message->sequence = sendSequences[message->stream]++;
+        if(message->delivery == Delivery::RELIABLE_ORDERED)
+            sendStreams[message->stream]->outstanding.emplace_back(message->id, message->sequence);
+    }
+
+    //Packet numbers go on, so acknowledgements sent by peer before it noticed reset can't match new datagrams
+    largestAcknowledged = 0;
+    latestRtt = 0;
+    smoothedRtt = RELIABLE_INITIAL_RTT;
+    rttVariation = RELIABLE_INITIAL_RTT / 2;
+    minRtt = 0;
+    lossTime = 0;
+    lastAckElicitingSent = 0;
+    probeTimeouts = 0;
+    probes = 0;
+    congestionWindow = RELIABLE_INITIAL_WINDOW;
+    slowStartThreshold = UINT64_MAX;
+    bytesInFlight = 0;
+    recoveryStart = 0;
+    nextSendTime = 0;
+
+    receivedRanges.clear();
+    largestReceivedTime = 0;
+    receivedSinceAck = 0;
+    ackElicitingReceived = 0;
+    ackDeadline = 0;
+    ackImmediately = false;
+}
+
+
+///////////////////////////////////////////////
+bool sj::ReliableUDPSocket::isSendBlocked(const std::uint8_t stream) {
+    if(sendQueue.size() + unacknowledged.size() >= RELIABLE_PENDING_MAX)
+        return true;
+    if(sendStreams[stream] == nullptr)
+        return false;
+
+    //Messages leave 'sendQueue' in order of their IDs, so older ones not found 
+    //in 'unacknowledged' were acknowledged already
+    std::deque<std::pair<std::uint64_t, std::uint32_t>>& outstanding = sendStreams[stream]->outstanding;
+    while(outstanding.empty() == false && unacknowledged.count(outstanding.front().first) == 0 &&
+          (sendQueue.empty() || outstanding.front().first < sendQueue.front()->id))
+        outstanding.pop_front();
+
+    return outstanding.empty() == false && sendSequences[stream] - outstanding.front().second >= RELIABLE_RECEIVE_WINDOW;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::ReliableUDPSocket::waitForEvents(const int timeoutMs) {
+    pollfd descriptor;
+    descriptor.fd = udpSocket.socket.getFD();
+    descriptor.events = POLLIN;
+    descriptor.revents = 0;
+    if(poll(&descriptor, 1, timeoutMs) == -1 && errno != EINTR)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::receiveDatagrams(const std::uint64_t now) {
+    while(true){
+        //Until peer is known datagrams are taken one by one, as connecting to the first valid one filters the rest
+        const size_t maxPackets = connected == true ? UDP_BATCH_MAX : 1;
+        size_t receivedPackets = 0;
+        senders.clear();
+        //Errors (like ICMP port unreachable before peer binds) are treated as losses
+        if(udpSocket.receiveBatch(datagrams, maxPackets, &receivedPackets, connected == true ? nullptr : &senders) != Status::OK)
+            break;
+
+        for(size_t i = 0; i < receivedPackets; i++){
+            stats.datagramsReceived++;
+            if(processDatagram(datagrams[i], now) == true && connected == false && i < senders.size()){
+                if(udpSocket.connect(senders[i]) == Status::OK)
+                    connected = true;
+            }
+        }
+        DataPacketPool::local().release(datagrams);
+
+        if(receivedPackets < maxPackets)
+            break;
+    }
+}
+
+
+///////////////////////////////////////////////
+bool sj::ReliableUDPSocket::processDatagram(DataPacket& datagram, const std::uint64_t now) {
+    std::uint8_t version = 0;
+    std::uint8_t flags = 0;
+    std::uint32_t datagramSession = 0;
+    std::uint32_t truncatedNumber = 0;
+    if(datagram.read(version, flags, datagramSession, truncatedNumber) == false || version != RELIABLE_VERSION || datagramSession == 0)
+        return false;
+
+    if(datagramSession != peerSession){
+        if(datagramSession == previousPeerSession)
+            return false;
+
+        //Peer restarted, nothing it sent or received before is valid
+        if(peerSession != 0){
+            previousPeerSession = peerSession;
+            resetConnection();
+        }
+        peerSession = datagramSession;
+    }
+
+    const std::uint64_t packetNumber = receivedRanges.empty() ? truncatedNumber : expandNumber(truncatedNumber, receivedRanges.front().second + 1);
+    if((flags & RELIABLE_FLAG_ACK) != 0 && processAcknowledgement(datagram, now) == false)
+        return false;
+
+    const bool ackEliciting = (flags & RELIABLE_FLAG_PING) != 0 || datagram.allDataReaded() != Status::OK;
+    if(recordReceived(packetNumber, ackEliciting, now) == false){
+        stats.duplicateDatagrams++;
+        return true;
+    }
+
+    while(datagram.allDataReaded() != Status::OK){
+        std::uint8_t stream = 0;
+        std::uint8_t frameFlags = 0;
+        std::uint32_t sequence = 0;
+        BytesView bytes;
+        if(datagram.read(stream, frameFlags, sequence) == false || datagram.readBytes(bytes) == false)
+            break;
+
+        const std::uint8_t delivery = frameFlags & ~RELIABLE_FLAG_COMPRESSED;
+        if(delivery > (std::uint8_t) Delivery::LATEST_ONLY)
+            continue;
+
+        DataPacket message = DataPacketPool::local().acquire();
+        if(bytes.size() != 0)
+            std::memcpy(message.grow(bytes.size()), bytes.data(), bytes.size());
+        message.compressed = (frameFlags & RELIABLE_FLAG_COMPRESSED) != 0;
+        if(message.compressed == true && message.decompress() == false)
+            continue;
+
+        deliver(stream, (Delivery) delivery, sequence, std::move(message));
+    }
+
+    return true;
+}
+
+
+///////////////////////////////////////////////
+bool sj::ReliableUDPSocket::processAcknowledgement(DataPacket& datagram, const std::uint64_t now) {
+    std::uint32_t truncatedLargest = 0;
+    std::uint16_t ackDelay = 0;
+    std::uint8_t rangesCount = 0;
+    std::uint32_t firstRangeLength = 0;
+    if(datagram.read(truncatedLargest, ackDelay, rangesCount, firstRangeLength) == false || rangesCount == 0 || rangesCount > RELIABLE_ACK_RANGES_MAX)
+        return false;
+
+    const std::uint64_t largest = expandNumber(truncatedLargest, nextPacketNumber - 1);
+    if(largest >= nextPacketNumber || firstRangeLength >= largest)
+        return false;
+
+    //Ranges are checked before any of them is applied
+    std::pair<std::uint64_t, std::uint64_t> ranges[RELIABLE_ACK_RANGES_MAX];
+    ranges[0] = std::make_pair(largest - firstRangeLength, largest);
+    for(size_t i = 1; i < rangesCount; i++){
+        std::uint32_t gap = 0;
+        std::uint32_t length = 0;
+        if(datagram.read(gap, length) == false || (std::uint64_t) gap + 1 >= ranges[i - 1].first)
+            return false;
+
+        const std::uint64_t highest = ranges[i - 1].first - gap - 1;
+        if(length >= highest)
+            return false;
+
+        ranges[i] = std::make_pair(highest - length, highest);
+    }
+
+    bool newlyAcknowledged = false;
+    std::uint64_t largestSentTime = 0;
+    for(size_t i = 0; i < rangesCount; i++){
+        std::map<std::uint64_t, std::unique_ptr<SentPacket>>::iterator packet = sentPackets.lower_bound(ranges[i].first);
+        while(packet != sentPackets.end() && packet->first <= ranges[i].second){
+            const SentPacket& sentPacket = *packet->second;
+            if(packet->first == largest)
+                largestSentTime = sentPacket.sentTime;
+
+            for(const std::uint64_t messageID : sentPacket.messageIDs)
+                unacknowledged.erase(messageID);
+
+            bytesInFlight -= sentPacket.size;
+            if(sentPacket.sentTime > recoveryStart){
+                if(congestionWindow < slowStartThreshold)
+                    congestionWindow += sentPacket.size;
+                else
+                    congestionWindow += RELIABLE_DATAGRAM_SIZE * sentPacket.size / congestionWindow;
+            }
+
+            newlyAcknowledged = true;
+            packet = sentPackets.erase(packet);
+        }
+    }
+
+    if(largest > largestAcknowledged)
+        largestAcknowledged = largest;
+
+    if(largestSentTime != 0)
+        updateRtt(now - largestSentTime, (std::uint64_t) ackDelay * 16000);
+
+    if(newlyAcknowledged == true){
+        probeTimeouts = 0;
+        detectLostPackets(now);
+    }
+
+    return true;
+}
+
+
+///////////////////////////////////////////////
+bool sj::ReliableUDPSocket::recordReceived(const std::uint64_t packetNumber, const bool ackEliciting, const std::uint64_t now) {
+    //Ranges are sorted from the highest, first one not above 'packetNumber' is looked for
+    size_t i = 0;
+    while(i < receivedRanges.size() && receivedRanges[i].first > packetNumber)
+        i++;
+
+    if(i < receivedRanges.size() && receivedRanges[i].second >= packetNumber)
+        return false;
+
+    //Older than every remembered range, it can't be told whether it's duplicate
+    if(i == receivedRanges.size() && receivedRanges.size() == RELIABLE_ACK_RANGES_MAX)
+        return false;
+
+    const bool inOrder = receivedRanges.empty() || packetNumber == receivedRanges.front().second + 1;
+    if(i == 0)
+        largestReceivedTime = now;
+
+    if(i < receivedRanges.size() && receivedRanges[i].second + 1 == packetNumber)
+        receivedRanges[i].second = packetNumber;
+    else
+        receivedRanges.insert(receivedRanges.begin() + i, std::make_pair(packetNumber, packetNumber));
+
+    if(i > 0 && receivedRanges[i - 1].first == receivedRanges[i].second + 1){
+        receivedRanges[i - 1].first = receivedRanges[i].first;
+        receivedRanges.erase(receivedRanges.begin() + i);
+    }
+
+    while(receivedRanges.size() > RELIABLE_ACK_RANGES_MAX)
+        receivedRanges.pop_back();
+
+    receivedSinceAck++;
+    if(ackEliciting == true){
+        if(ackElicitingReceived++ == 0)
+            ackDeadline = now + RELIABLE_ACK_DELAY_MAX;
+
+        //Gap tells sender about loss sooner when it's acknowledged at once
+        if(inOrder == false)
+            ackImmediately = true;
+    }
+
+    return true;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::deliver(const std::uint8_t stream, const Delivery delivery, const std::uint32_t sequence, DataPacket&& message) {
+    if(receiveStreams[stream] == nullptr){
+        receiveStreams[stream].reset(new ReceiveStream());
+        receiveStreams[stream]->nextSequence = 0;
+        receiveStreams[stream]->latestDelivered = false;
+        receiveStreams[stream]->latestSequence = 0;
+    }
+    ReceiveStream& receiveStream = *receiveStreams[stream];
+
+    if(delivery == Delivery::UNRELIABLE){
+        receivedMessages.emplace_back(stream, std::move(message));
+        stats.messagesReceived++;
+        return;
+    }
+
+    if(delivery == Delivery::LATEST_ONLY){
+        if(receiveStream.latestDelivered == true && isSendBefore(sequence, receiveStream.latestSequence + 1))
+            return;
+
+        receiveStream.latestDelivered = true;
+        receiveStream.latestSequence = sequence;
+        receivedMessages.emplace_back(stream, std::move(message));
+        stats.messagesReceived++;
+        return;
+    }
+
+    //Already delivered ones are resent when their acknowledgement was lost
+    const std::uint32_t offset = sequence - receiveStream.nextSequence;
+    if(offset >= RELIABLE_RECEIVE_WINDOW)
+        return;
+
+    if(receiveStream.window.size() <= offset)
+        receiveStream.window.resize(offset + 1);
+
+    if(receiveStream.window[offset].first == true)
+        return;
+
+    receiveStream.window[offset].first = true;
+    receiveStream.window[offset].second = std::move(message);
+
+    while(receiveStream.window.empty() == false && receiveStream.window.front().first == true){
+        receivedMessages.emplace_back(stream, std::move(receiveStream.window.front().second));
+        receiveStream.window.pop_front();
+        receiveStream.nextSequence++;
+        stats.messagesReceived++;
+    }
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::updateRtt(const std::uint64_t rttSample, const std::uint64_t ackDelay) {
+    latestRtt = rttSample;
+    if(minRtt == 0){
+        minRtt = std::max<std::uint64_t>(rttSample, 1);
+        smoothedRtt = rttSample;
+        rttVariation = rttSample / 2;
+        return;
+    }
+
+    minRtt = std::min(minRtt, rttSample);
+
+    //Time peer held acknowledgement is not part of path RTT, unless it would go below minimum
+    const std::uint64_t peerDelay = std::min<std::uint64_t>(ackDelay, RELIABLE_ACK_DELAY_MAX);
+    const std::uint64_t adjustedRtt = rttSample >= minRtt + peerDelay ? rttSample - peerDelay : rttSample;
+    const std::uint64_t difference = smoothedRtt > adjustedRtt ? smoothedRtt - adjustedRtt : adjustedRtt - smoothedRtt;
+    rttVariation = (3 * rttVariation + difference) / 4;
+    smoothedRtt = (7 * smoothedRtt + adjustedRtt) / 8;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::detectLostPackets(const std::uint64_t now) {
+    lossTime = 0;
+    if(largestAcknowledged == 0)
+        return;
+
+    const std::uint64_t lossDelay = std::max<std::uint64_t>(std::max(latestRtt, smoothedRtt) * 9 / 8, 1000000);
+    std::uint64_t lostSentTime = 0;
+    std::map<std::uint64_t, std::unique_ptr<SentPacket>>::iterator packet = sentPackets.begin();
+    while(packet != sentPackets.end() && packet->first < largestAcknowledged){
+        const SentPacket& sentPacket = *packet->second;
+        if(largestAcknowledged - packet->first < RELIABLE_PACKET_THRESHOLD && now - sentPacket.sentTime < lossDelay){
+            if(lossTime == 0 || sentPacket.sentTime + lossDelay < lossTime)
+                lossTime = sentPacket.sentTime + lossDelay;
+            ++packet;
+            continue;
+        }
+
+        for(const std::uint64_t messageID : sentPacket.messageIDs)
+            requeue(messageID, packet->first);
+
+        bytesInFlight -= sentPacket.size;
+        lostSentTime = std::max(lostSentTime, sentPacket.sentTime);
+        stats.lostDatagrams++;
+        packet = sentPackets.erase(packet);
+    }
+
+    //One reduction per round trip, losses of datagrams sent before it are part of the same event
+    if(lostSentTime > recoveryStart){
+        recoveryStart = now;
+        congestionWindow = std::max<std::uint64_t>(congestionWindow / 2, RELIABLE_MINIMUM_WINDOW);
+        slowStartThreshold = congestionWindow;
+    }
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::requeue(const std::uint64_t messageID, const std::uint64_t packetNumber) {
+    //Message could be acknowledged or resent already in other datagram
+    const std::unordered_map<std::uint64_t, std::unique_ptr<Message>>::iterator message = unacknowledged.find(messageID);
+    if(message == unacknowledged.end() || message->second->packetNumber != packetNumber || message->second->queued == true)
+        return;
+
+    message->second->queued = true;
+    retransmissions.push_back(messageID);
+    stats.retransmittedMessages++;
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::ReliableUDPSocket::getProbeDeadline() {
+    const std::uint64_t probeTimeout = smoothedRtt + std::max<std::uint64_t>(4 * rttVariation, 1000000) + RELIABLE_ACK_DELAY_MAX;
+    return lastAckElicitingSent + (probeTimeout << std::min(probeTimeouts, (unsigned) RELIABLE_PROBE_BACKOFF_MAX));
+}
+
+
+///////////////////////////////////////////////
+std::uint64_t sj::ReliableUDPSocket::getNextDeadline() {
+    std::uint64_t deadline = 0;
+    const auto includeDeadline = [&deadline](const std::uint64_t time){
+        if(deadline == 0 || time < deadline)
+            deadline = time;
+    };
+
+    if(ackElicitingReceived > 0)
+        includeDeadline(ackImmediately == true || ackElicitingReceived >= 2 ? 1 : ackDeadline);
+
+    if(lossTime != 0)
+        includeDeadline(lossTime);
+    else if(sentPackets.empty() == false)
+        includeDeadline(getProbeDeadline());
+
+    if(delayedDatagrams.empty() == false)
+        includeDeadline(delayedDatagrams.begin()->first);
+
+    const bool dataWaiting = sendQueue.empty() == false || retransmissions.empty() == false;
+    if(connected == true && dataWaiting == true && (probes > 0 || bytesInFlight + RELIABLE_DATAGRAM_SIZE <= congestionWindow))
+        includeDeadline(std::max<std::uint64_t>(nextSendTime, 1));
+
+    return deadline;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::sendDatagrams(const std::uint64_t now) {
+    if(connected == false)
+        return;
+
+    while(true){
+        //IDs of messages acknowledged after they were declared lost are skipped
+        while(retransmissions.empty() == false){
+            const std::unordered_map<std::uint64_t, std::unique_ptr<Message>>::iterator message = unacknowledged.find(retransmissions.front());
+            if(message != unacknowledged.end() && message->second->queued == true)
+                break;
+            retransmissions.pop_front();
+        }
+
+        const bool dataWaiting = retransmissions.empty() == false || sendQueue.empty() == false;
+        const bool windowOpen = probes > 0 || (bytesInFlight + RELIABLE_DATAGRAM_SIZE <= congestionWindow && now >= nextSendTime);
+        const bool sendData = dataWaiting == true && windowOpen == true;
+        const bool sendPing = probes > 0 && dataWaiting == false;
+        const bool ackDue = ackElicitingReceived > 0 && (ackImmediately == true || ackElicitingReceived >= 2 || now >= ackDeadline);
+        if(sendData == false && sendPing == false && ackDue == false)
+            return;
+
+        const std::uint64_t packetNumber = nextPacketNumber++;
+        const bool sendAck = receivedSinceAck > 0 && receivedRanges.empty() == false;
+        DataPacket datagram = DataPacketPool::local().acquire();
+        datagram.write((std::uint8_t) RELIABLE_VERSION, (std::uint8_t) ((sendAck ? RELIABLE_FLAG_ACK : 0) | (sendPing ? RELIABLE_FLAG_PING : 0)),
+                       session, (std::uint32_t) packetNumber);
+        if(sendAck == true)
+            writeAcknowledgement(datagram, now);
+
+        std::unique_ptr<SentPacket> sentPacket(new SentPacket());
+        size_t frames = 0;
+        while(sendData == true){
+            Message* message = nullptr;
+            if(retransmissions.empty() == false){
+                const std::unordered_map<std::uint64_t, std::unique_ptr<Message>>::iterator lostMessage = unacknowledged.find(retransmissions.front());
+                if(lostMessage == unacknowledged.end() || lostMessage->second->queued == false){
+                    retransmissions.pop_front();
+                    continue;
+                }
+                message = lostMessage->second.get();
+            }
+            else if(sendQueue.empty() == false){
+                message = sendQueue.front().get();
+            }
+            else{
+                break;
+            }
+
+            const size_t frameSize = 6 + DATAPACKET_HEADER_SIZE_MAX + message->dataPacket.size();
+            if(frames > 0 && datagram.size() + frameSize > RELIABLE_DATAGRAM_SIZE)
+                break;
+
+            datagram.write(message->stream, (std::uint8_t) ((std::uint8_t) message->delivery | (message->dataPacket.isCompressed() ? RELIABLE_FLAG_COMPRESSED : 0)), message->sequence);
+            datagram.writeBytes(message->dataPacket.data(), message->dataPacket.size());
+            frames++;
+
+            if(message->queued == true){
+                message->queued = false;
+                message->packetNumber = packetNumber;
+                sentPacket->messageIDs.push_back(message->id);
+                retransmissions.pop_front();
+            }
+            else if(message->delivery == Delivery::RELIABLE_ORDERED){
+                message->packetNumber = packetNumber;
+                sentPacket->messageIDs.push_back(message->id);
+                unacknowledged.emplace(message->id, std::move(sendQueue.front()));
+                sendQueue.pop_front();
+            }
+            else{
+                DataPacketPool::local().release(std::move(message->dataPacket));
+                sendQueue.pop_front();
+            }
+        }
+
+        //Unreliable messages are acknowledged too, so they count for RTT and congestion window
+        if(frames > 0 || sendPing == true){
+            sentPacket->sentTime = now;
+            sentPacket->size = datagram.size();
+            bytesInFlight += sentPacket->size;
+            lastAckElicitingSent = now;
+
+            if(probes > 0){
+                probes--;
+            }
+            else{
+                //Spreads congestion window over smoothed RTT (at 5/4 of its rate), with short bursts allowed
+                const std::uint64_t interval = sentPacket->size * smoothedRtt * 4 / (5 * congestionWindow);
+                const std::uint64_t burst = interval * RELIABLE_PACING_BURST;
+                if(nextSendTime + burst < now)
+                    nextSendTime = now - burst;
+                nextSendTime += interval;
+            }
+
+            sentPackets.emplace(packetNumber, std::move(sentPacket));
+        }
+
+        transmit(datagram, now);
+    }
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::writeAcknowledgement(DataPacket& datagram, const std::uint64_t now) {
+    //Delay is sent in units of 16 microseconds
+    const std::uint64_t ackDelay = std::min<std::uint64_t>((now - largestReceivedTime) / 16000, UINT16_MAX);
+    datagram.write((std::uint32_t) receivedRanges.front().second, (std::uint16_t) ackDelay, (std::uint8_t) receivedRanges.size(),
+                   (std::uint32_t) (receivedRanges.front().second - receivedRanges.front().first));
+
+    for(size_t i = 1; i < receivedRanges.size(); i++){
+        const std::uint64_t gap = receivedRanges[i - 1].first - receivedRanges[i].second - 1;
+        datagram.write((std::uint32_t) gap, (std::uint32_t) (receivedRanges[i].second - receivedRanges[i].first));
+    }
+
+    receivedSinceAck = 0;
+    ackElicitingReceived = 0;
+    ackDeadline = 0;
+    ackImmediately = false;
+}
+
+
+///////////////////////////////////////////////
+void sj::ReliableUDPSocket::transmit(DataPacket& datagram, const std::uint64_t now) {
+    stats.datagramsSent++;
+
+    if(linkSimulation.lossRatio > 0 && (nextRandom(randomState) >> 11) * (1.0 / (1ull << 53)) < linkSimulation.lossRatio){
+        stats.simulatedLosses++;
+        DataPacketPool::local().release(std::move(datagram));
+        return;
+    }
+
+    std::uint64_t delay = (std::uint64_t) std::max(linkSimulation.delayMs, 0) * 1000000;
+    if(linkSimulation.jitterMs > 0)
+        delay += nextRandom(randomState) % ((std::uint64_t) linkSimulation.jitterMs * 1000000);
+
+    if(delay > 0){
+        delayedDatagrams.emplace(now + delay, std::move(datagram));
+        return;
+    }
+
+    //Full socket buffer is one more loss, handled like the others
+    udpSocket.send(datagram);
+    DataPacketPool::local().release(std::move(datagram));
+}
+
+
+///////////////////////////////////////////////
+//  SharedMemorySocket Class
+///////////////////////////////////////////////
+//Control block of one direction, cursors of both sides are on separate cache lines
+struct sj::SharedMemorySocket::Ring{
+    alignas(64) std::atomic<std::uint64_t> head;//Bytes written, moved by sender
+    alignas(64) std::atomic<std::uint64_t> tail;//Bytes read, moved by receiver
+    alignas(64) std::atomic<std::uint32_t> dataSignal;//Futex changed when data is added for sleeping receiver
+    std::atomic<std::uint32_t> receiverSleeping;
+    alignas(64) std::atomic<std::uint32_t> spaceSignal;//Futex changed when space is freed for sleeping sender
+    std::atomic<std::uint32_t> senderSleeping;
+};
+
+
+//Beginning of shared memory, followed by data of both rings
+struct sj::SharedMemorySocket::Channel{
+    std::atomic<std::uint32_t> ready;//SHARED_MEMORY_MAGIC when creator initialized channel
+    std::atomic<std::uint32_t> opened;//Other side opened channel
+    std::atomic<std::uint32_t> closed;//Any side disconnected
+    std::uint64_t capacity;
+    Ring rings[2];//Creator sends with the first one
+};
+
+
+///////////////////////////////////////////////
+static void futexWait(std::atomic<std::uint32_t>& futex, const std::uint32_t value) {
+    //Not private, as other process waits on the same memory
+    syscall(SYS_futex, (std::uint32_t*) &futex, FUTEX_WAIT, value, nullptr, nullptr, 0);
+}
+
+
+///////////////////////////////////////////////
+static void futexWake(std::atomic<std::uint32_t>& futex, const int waiters = INT_MAX) {
+    futex.fetch_add(1, std::memory_order_seq_cst);
+    syscall(SYS_futex, (std::uint32_t*) &futex, FUTEX_WAKE, waiters, nullptr, nullptr, 0);
+}
+
+
+//Repeats 'isReady' up to 'microseconds', returns its last result
+template<typename Condition>
+static bool spinUntil(const int microseconds, Condition isReady) {
+    if(microseconds <= 0)
+        return false;
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    do{
+        for(int i = 0; i < 64; i++){
+            if(isReady())
+                return true;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    } while(elapsedNanoseconds(startTime) < (std::uint64_t) microseconds * 1000);
+
+    return isReady();
+}
+
+
+///////////////////////////////////////////////
+sj::SharedMemorySocket::SharedMemorySocket(const Mode mode) 
+    : mode(mode), creator(false), channel(nullptr), channelSize(0), capacity(0), 
+      sendRing(nullptr), receiveRing(nullptr), sendData(nullptr), receiveData(nullptr), busyPollMicroseconds(0) {
+
+}
+
+
+///////////////////////////////////////////////
+sj::SharedMemorySocket::~SharedMemorySocket() {
+    disconnect();
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::create(const std::string& name, const size_t capacity) {
+    if(channel != nullptr || capacity == 0 || capacity > SHARED_MEMORY_CAPACITY_MAX)
+        return Status::ERROR;
+
+    size_t ringCapacity = 64;
+    while(ringCapacity < capacity)
+        ringCapacity <<= 1;
+
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd == -1)
+        return Status::ERROR;
+
+    const size_t size = sizeof(Channel) + 2 * ringCapacity;
+    if(ftruncate(fd, size) == -1 || map(fd, size) != Status::OK){
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return Status::ERROR;
+    }
+    ::close(fd);
+
+    //New memory is zeroed, so only capacity has to be set before channel is marked ready
+    channel->capacity = ringCapacity;
+    channel->ready.store(SHARED_MEMORY_MAGIC, std::memory_order_release);
+
+    this->name = name;
+    this->capacity = ringCapacity;
+    creator = true;
+    sendRing = &channel->rings[0];
+    receiveRing = &channel->rings[1];
+    sendData = (char*) channel + sizeof(Channel);
+    receiveData = sendData + ringCapacity;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::open(const std::string& name) {
+    if(channel != nullptr)
+        return Status::ERROR;
+
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if(fd == -1)
+        return Status::ERROR;
+
+    struct stat fileStatus;
+    if(fstat(fd, &fileStatus) == -1 || (size_t) fileStatus.st_size < sizeof(Channel) || map(fd, fileStatus.st_size) != Status::OK){
+        ::close(fd);
+        return Status::ERROR;
+    }
+    ::close(fd);
+
+    //Channel can be opened only once
+    if(channel->ready.load(std::memory_order_acquire) != SHARED_MEMORY_MAGIC || sizeof(Channel) + 2 * channel->capacity != channelSize ||
+       channel->opened.exchange(1) != 0){
+        unmap();
+        return Status::ERROR;
+    }
+
+    this->name = name;
+    capacity = channel->capacity;
+    creator = false;
+    sendRing = &channel->rings[1];
+    receiveRing = &channel->rings[0];
+    receiveData = (char*) channel + sizeof(Channel);
+    sendData = receiveData + capacity;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::disconnect() {
+    if(channel == nullptr)
+        return Status::ERROR;
+
+    //Sleeping other side checks 'closed' after it's woken
+    channel->closed.store(1, std::memory_order_seq_cst);
+    for(Ring& ring : channel->rings){
+        futexWake(ring.dataSignal);
+        futexWake(ring.spaceSignal);
+    }
+
+    unmap();
+    if(creator && shm_unlink(name.c_str()) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+bool sj::SharedMemorySocket::isConnected() {
+    return channel != nullptr && channel->closed.load(std::memory_order_relaxed) == 0;
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::setBusyPoll(const int microseconds) {
+    busyPollMicroseconds = microseconds;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::send(DataPacket& dataPacket) {
+    if(channel == nullptr)
+        return Status::ERROR;
+
+    char header[DATAPACKET_HEADER_SIZE_MAX];
+    const size_t headerSize = encodeDataPacketHeader(dataPacket, header);
+    std::uint64_t head = sendRing->head.load(std::memory_order_relaxed);
+    const Status status = waitForSpace(headerSize + dataPacket.size(), head, true);
+    if(status != Status::OK)
+        return status;
+
+    write(header, headerSize, head);
+    write(dataPacket.data(), dataPacket.size(), head);
+    publish(head);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::send(std::vector<DataPacket>& dataPackets) {
+    if(channel == nullptr)
+        return Status::ERROR;
+
+    std::uint64_t head = sendRing->head.load(std::memory_order_relaxed);
+    //NON_BLOCKING Mode can't wait in the middle of batch, so all of it has to fit at once
+    if(mode == Mode::NON_BLOCKING){
+        size_t batchSize = 0;
+        for(size_t i = 0; i < dataPackets.size(); i++){
+            char header[DATAPACKET_HEADER_SIZE_MAX];
+            batchSize += encodeDataPacketHeader(dataPackets[i], header) + dataPackets[i].size();
+        }
+
+        const Status status = waitForSpace(batchSize, head, true);
+        if(status != Status::OK)
+            return status;
+    }
+
+    for(size_t i = 0; i < dataPackets.size(); i++){
+        char header[DATAPACKET_HEADER_SIZE_MAX];
+        const size_t headerSize = encodeDataPacketHeader(dataPackets[i], header);
+        const size_t frameSize = headerSize + dataPackets[i].size();
+
+        if(mode == Mode::BLOCKING){
+            //Written packets are made visible before waiting, otherwise ring would never be freed
+            if(capacity - (head - sendRing->tail.load(std::memory_order_acquire)) < frameSize && i != 0)
+                publish(head);
+
+            const Status status = waitForSpace(frameSize, head, false);
+            if(status != Status::OK)
+                return status;
+        }
+
+        write(header, headerSize, head);
+        write(dataPackets[i].data(), dataPackets[i].size(), head);
+    }
+
+    publish(head);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::receiveInto(DataPacket& dataPacket) {
+    if(channel == nullptr)
+        return Status::ERROR;
+
+    std::uint64_t tail = receiveRing->tail.load(std::memory_order_relaxed);
+    Status status = waitForData(tail);
+    if(status != Status::OK)
+        return status;
+
+    status = readDataPacket(dataPacket, tail);
+    consume(tail);
+    return status;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets) {
+    *receivedPackets = 0;
+    if(channel == nullptr)
+        return Status::ERROR;
+
+    std::uint64_t tail = receiveRing->tail.load(std::memory_order_relaxed);
+    Status status = waitForData(tail);
+    if(status != Status::OK)
+        return status;
+
+    //Space of all taken packets is freed at once
+    DataPacketPool& dataPacketPool = DataPacketPool::local();
+    const std::uint64_t head = receiveRing->head.load(std::memory_order_acquire);
+    while(tail != head && status == Status::OK){
+        dataPackets.push_back(dataPacketPool.acquire());
+        status = readDataPacket(dataPackets.back(), tail);
+        if(status != Status::OK){
+            dataPacketPool.release(std::move(dataPackets.back()));
+            dataPackets.pop_back();
+        }
+        else
+            (*receivedPackets)++;
+    }
+
+    consume(tail);
+    return status;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::map(const int fd, const size_t size) {
+    void* const memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED)
+        return Status::ERROR;
+
+    channel = (Channel*) memory;
+    channelSize = size;
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::unmap() {
+    munmap(channel, channelSize);
+    channel = nullptr;
+    channelSize = 0;
+    sendRing = nullptr;
+    receiveRing = nullptr;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::waitForSpace(const size_t frameSize, const std::uint64_t head, const bool canBeUnavailable) {
+    if(frameSize > capacity)
+        return Status::ERROR;
+
+    Ring& ring = *sendRing;
+    Channel& sharedChannel = *channel;
+    const size_t ringCapacity = capacity;
+    auto hasSpace = [&ring, head, frameSize, ringCapacity](){
+        return ringCapacity - (head - ring.tail.load(std::memory_order_acquire)) >= frameSize;
+    };
+
+    while(true){
+        if(sharedChannel.closed.load(std::memory_order_acquire) != 0)
+            return Status::ERROR;
+
+        if(hasSpace())
+            return Status::OK;
+
+        if(mode == Mode::NON_BLOCKING && canBeUnavailable)
+            return Status::UNAVAILABLE;
+
+        if(spinUntil(busyPollMicroseconds, hasSpace))
+            continue;
+
+        //Receiver checks 'senderSleeping' after moving tail, so one of both sees the other
+        const std::uint32_t signal = ring.spaceSignal.load(std::memory_order_seq_cst);
+        ring.senderSleeping.store(1, std::memory_order_seq_cst);
+        if(hasSpace() == false && sharedChannel.closed.load(std::memory_order_seq_cst) == 0)
+            futexWait(ring.spaceSignal, signal);
+        ring.senderSleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::waitForData(const std::uint64_t tail) {
+    Ring& ring = *receiveRing;
+    Channel& sharedChannel = *channel;
+    auto hasData = [&ring, tail](){
+        return ring.head.load(std::memory_order_acquire) != tail;
+    };
+
+    while(true){
+        if(hasData())
+            return Status::OK;
+
+        //Packets sent before other side disconnected are still received
+        if(sharedChannel.closed.load(std::memory_order_acquire) != 0)
+            return hasData() ? Status::OK : Status::ERROR;
+
+        if(mode == Mode::NON_BLOCKING)
+            return Status::UNAVAILABLE;
+
+        if(spinUntil(busyPollMicroseconds, hasData))
+            continue;
+
+        const std::uint32_t signal = ring.dataSignal.load(std::memory_order_seq_cst);
+        ring.receiverSleeping.store(1, std::memory_order_seq_cst);
+        if(hasData() == false && sharedChannel.closed.load(std::memory_order_seq_cst) == 0)
+            futexWait(ring.dataSignal, signal);
+        ring.receiverSleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::publish(const std::uint64_t head) {
+    sendRing->head.store(head, std::memory_order_seq_cst);
+    if(sendRing->receiverSleeping.load(std::memory_order_seq_cst) != 0)
+        futexWake(sendRing->dataSignal);
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::consume(const std::uint64_t tail) {
+    receiveRing->tail.store(tail, std::memory_order_seq_cst);
+    if(receiveRing->senderSleeping.load(std::memory_order_seq_cst) != 0)
+        futexWake(receiveRing->spaceSignal);
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::write(const void* data, const size_t size, std::uint64_t& head) {
+    //Bytes which don't fit before end of ring continue from its beginning
+    const size_t position = head & (capacity - 1);
+    const size_t firstPart = std::min(size, capacity - position);
+    memcpy(sendData + position, data, firstPart);
+    memcpy(sendData, (const char*) data + firstPart, size - firstPart);
+    head += size;
+}
+
+
+///////////////////////////////////////////////
+void sj::SharedMemorySocket::read(void* data, const size_t size, std::uint64_t& tail) {
+    const size_t position = tail & (capacity - 1);
+    const size_t firstPart = std::min(size, capacity - position);
+    memcpy(data, receiveData + position, firstPart);
+    memcpy((char*) data + firstPart, receiveData, size - firstPart);
+    tail += size;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::SharedMemorySocket::readDataPacket(DataPacket& dataPacket, std::uint64_t& tail) {
+    //Header is copied out, as it can be split by end of ring
+    const std::uint64_t head = receiveRing->head.load(std::memory_order_acquire);
+    char header[DATAPACKET_HEADER_SIZE_MAX];
+    std::uint64_t headerTail = tail;
+    read(header, std::min<std::uint64_t>(sizeof(header), head - tail), headerTail);
+
+    size_t packetSize, headerSize;
+    bool compressed;
+    if(decodeDataPacketHeader(header, std::min<std::uint64_t>(sizeof(header), head - tail), &packetSize, &headerSize, &compressed) != Status::OK ||
+       headerSize + packetSize > head - tail)
+        return Status::ERROR;
+    tail += headerSize;
+
+    if(compressed == false){
+        if(packetSize != 0)
+            read(dataPacket.grow(packetSize), packetSize, tail);
+        return Status::OK;
+    }
+
+    //Decompressed into pooled packet, appended if caller's packet has data already
+    DataPacket compressedPacket = DataPacketPool::local().acquire();
+    read(compressedPacket.grow(packetSize), packetSize, tail);
+    compressedPacket.compressed = true;
+    Status status = Status::OK;
+    if(compressedPacket.decompress() == false)
+        status = Status::ERROR;
+    else if(dataPacket.size() == 0)
+        std::swap(dataPacket, compressedPacket);
+    else
+        memcpy(dataPacket.grow(compressedPacket.size()), compressedPacket.data(), compressedPacket.size());
+
+    DataPacketPool::local().release(std::move(compressedPacket));
+    return status;
+}
+
+
+///////////////////////////////////////////////
+//  Poller Class
+///////////////////////////////////////////////
+static uint32_t toEpollEvents(const sj::Interest interest, const sj::Trigger trigger) {
+    uint32_t events = EPOLLRDHUP;
+    if((int) interest & (int) sj::Interest::READ)
+        events |= EPOLLIN;
+    if((int) interest & (int) sj::Interest::WRITE)
+        events |= EPOLLOUT;
+    if(trigger == sj::Trigger::EDGE)
+        events |= EPOLLET;
+
+    return events;
+}
+
+
+///////////////////////////////////////////////
+sj::Poller::Poller() 
+    : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+
+    if(epoll_fd != -1 && wake_fd != -1){
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = wake_fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) == -1){
+            ::close(wake_fd);
+            wake_fd = -1;
+        }
+    }
+}
+
+
+///////////////////////////////////////////////
+sj::Poller::~Poller() {
+    if(epoll_fd != -1)
+        ::close(epoll_fd);
+    if(wake_fd != -1)
+        ::close(wake_fd);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger, void* userData) {
+    return add(clientSocket.socket, interest, trigger, userData, nullptr);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger, void* userData) {
+    return add(listenSocket.socket, interest, trigger, userData, nullptr);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(UDPSocket& udpSocket, const Interest interest, const Trigger trigger, void* userData) {
+    return add(udpSocket.socket, interest, trigger, userData, nullptr);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger, Callback callback) {
+    return add(clientSocket.socket, interest, trigger, nullptr, std::move(callback));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger, Callback callback) {
+    return add(listenSocket.socket, interest, trigger, nullptr, std::move(callback));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(UDPSocket& udpSocket, const Interest interest, const Trigger trigger, Callback callback) {
+    return add(udpSocket.socket, interest, trigger, nullptr, std::move(callback));
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::modify(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger) {
+    return modify(clientSocket.socket, interest, trigger);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::modify(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger) {
+    return modify(listenSocket.socket, interest, trigger);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::modify(UDPSocket& udpSocket, const Interest interest, const Trigger trigger) {
+    return modify(udpSocket.socket, interest, trigger);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::remove(TCPClientSocket& clientSocket) {
+    return remove(clientSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::remove(TCPListenSocket& listenSocket) {
+    return remove(listenSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::remove(UDPSocket& udpSocket) {
+    return remove(udpSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::wait(std::vector<PollEvent>& readyEvents, const int timeoutMs) {
+    return wait(readyEvents, nullptr, timeoutMs);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::dispatch(const int timeoutMs) {
+    dispatchedEvents.clear();
+    dispatchedFDs.clear();
+
+    Status status = wait(dispatchedEvents, &dispatchedFDs, timeoutMs);
+    if(status != Status::OK)
+        return status;
+
+    for(size_t i = 0; i < dispatchedEvents.size(); i++){
+        //Callback could remove any socket, so registration is searched every time
+        auto registrationIt = registrations.find(dispatchedFDs[i]);
+        if(registrationIt == registrations.end() || !registrationIt->second.callback)
+            continue;
+
+        //Copy keeps callback alive, even if it removes its own socket
+        Callback callback = registrationIt->second.callback;
+        callback(dispatchedEvents[i]);
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::wake() {
+    if(wake_fd == -1)
+        return Status::ERROR;
+
+    //Counter saturates only after 2^64 wakes without wait, EAGAIN still means it's set
+    const std::uint64_t value = 1;
+    if(::write(wake_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::add(API_RESERVED::Socket& socket, const Interest interest, const Trigger trigger, void* userData, Callback callback) {
+    if(epoll_fd == -1 || socket.getFD() == -1)
+        return Status::ERROR;
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = toEpollEvents(interest, trigger);
+    event.data.fd = socket.getFD();
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket.getFD(), &event) == -1)
+        return Status::ERROR;
+
+    //Closed sockets leave their registration, so it's overwritten when FD is reused
+    Registration& registration = registrations[socket.getFD()];
+    registration.userData = userData;
+    registration.callback = std::move(callback);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::modify(API_RESERVED::Socket& socket, const Interest interest, const Trigger trigger) {
+    if(epoll_fd == -1 || socket.getFD() == -1)
+        return Status::ERROR;
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = toEpollEvents(interest, trigger);
+    event.data.fd = socket.getFD();
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, socket.getFD(), &event) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::remove(API_RESERVED::Socket& socket) {
+    if(epoll_fd == -1 || socket.getFD() == -1)
+        return Status::ERROR;
+
+    registrations.erase(socket.getFD());
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket.getFD(), nullptr) == -1)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Poller::wait(std::vector<PollEvent>& readyEvents, std::vector<int>* readyFDs, const int timeoutMs) {
+    if(epoll_fd == -1)
+        return Status::ERROR;
+
+    const int maxEvents = 256;
+    epoll_event events[maxEvents];
+    const int eventsCount = epoll_wait(epoll_fd, events, maxEvents, timeoutMs);
+    if(eventsCount == -1)
+        return errno == EINTR ? Status::OK : Status::ERROR;
+
+    for(int i = 0; i < eventsCount; i++){
+        const int fd = events[i].data.fd;
+        if(fd == wake_fd){
+            std::uint64_t value;
+            if(::read(wake_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                return Status::ERROR;
+            continue;
+        }
+
+        auto registrationIt = registrations.find(fd);
+
+        PollEvent readyEvent;
+        readyEvent.userData = registrationIt != registrations.end() ? registrationIt->second.userData : nullptr;
+        readyEvent.readable = (events[i].events & EPOLLIN) != 0;
+        readyEvent.writable = (events[i].events & EPOLLOUT) != 0;
+        readyEvent.closed = (events[i].events & (EPOLLRDHUP | EPOLLHUP)) != 0;
+        //Alone it can be only completion of zero copy send waiting in error queue
+        if((events[i].events & EPOLLERR) != 0 && readyEvent.closed == false){
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            readyEvent.closed = getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) == -1 || error != 0;
+        }
+        readyEvents.push_back(readyEvent);
+
+        if(readyFDs != nullptr)
+            readyFDs->push_back(fd);
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+//  IOUring Class
+///////////////////////////////////////////////
+struct sj::IOUring::Ring{
+    int ring_fd;
+
+    //Submission queue
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    io_uring_sqe* sqes;
+
+    //Completion queue
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    void* sqRingPtr;
+    size_t sqRingSize;
+    void* cqRingPtr;
+    size_t cqRingSize;
+    void* sqesPtr;
+    size_t sqesSize;
+
+    //Receive buffers registered in kernel, which picks one for every received chunk
+    io_uring_buf_ring* bufferRing;
+    size_t bufferRingSize;
+    unsigned short bufferRingTail;
+    std::unique_ptr<char[]> buffers;
+
+    Ring() 
+        : ring_fd(-1), sqRingPtr(MAP_FAILED), sqRingSize(0), cqRingPtr(MAP_FAILED), cqRingSize(0),
+          sqesPtr(MAP_FAILED), sqesSize(0), bufferRing((io_uring_buf_ring*) MAP_FAILED), bufferRingSize(0), bufferRingTail(0) {
+
+    }
+
+    ~Ring(){
+        close();
+    }
+
+    void close(){
+        if(ring_fd != -1)
+            ::close(ring_fd);
+        if(sqesPtr != MAP_FAILED)
+            munmap(sqesPtr, sqesSize);
+        if(cqRingPtr != MAP_FAILED && cqRingPtr != sqRingPtr)
+            munmap(cqRingPtr, cqRingSize);
+        if(sqRingPtr != MAP_FAILED)
+            munmap(sqRingPtr, sqRingSize);
+        if(bufferRing != MAP_FAILED)
+            munmap(bufferRing, bufferRingSize);
+
+        ring_fd = -1;
+        sqRingPtr = cqRingPtr = sqesPtr = MAP_FAILED;
+        bufferRing = (io_uring_buf_ring*) MAP_FAILED;
+    }
+
+    //Submits queued entries and waits for 'minComplete' completions
+    int enter(const unsigned minComplete, const int timeoutMs){
+        const unsigned toSubmit = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if(minComplete == 0 || timeoutMs < 0)
+            return (int) syscall(__NR_io_uring_enter, ring_fd, toSubmit, minComplete, minComplete != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+
+        __kernel_timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (std::uint64_t) &timeout;
+        return (int) syscall(__NR_io_uring_enter, ring_fd, toSubmit, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    //Returns cleared entry, which is submitted with next 'enter'
+    io_uring_sqe* nextSQE(){
+        const unsigned tail = *sqTail;
+        if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries){
+            enter(0, -1);
+            if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries)
+                return nullptr;
+        }
+
+        //Kernel reads entries only inside 'enter', so tail can be moved before entry is filled
+        io_uring_sqe* const sqe = &sqes[tail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[tail & sqMask] = tail & sqMask;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    char* getBuffer(const unsigned short bufferID){
+        return buffers.get() + bufferID * IO_URING_BUFFER_SIZE;
+    }
+
+    //Gives buffer back to kernel
+    void recycleBuffer(const unsigned short bufferID){
+        //Entries are indexed from ring start, 'bufs' member is misplaced in C++ (empty struct has size 1)
+        io_uring_buf* const buffer = (io_uring_buf*) bufferRing + (bufferRingTail & (IO_URING_BUFFERS_COUNT - 1));
+        buffer->addr = (std::uint64_t) getBuffer(bufferID);
+        buffer->len = IO_URING_BUFFER_SIZE;
+        buffer->bid = bufferID;
+        bufferRingTail++;
+        __atomic_store_n(&bufferRing->tail, bufferRingTail, __ATOMIC_RELEASE);
+    }
+};
+
+
+///////////////////////////////////////////////
+struct sj::IOUring::Operation{
+    IOCompletion::Type type;
+    std::uint64_t id;
+    int fd;
+    std::uint64_t registrationID;
+
+    //Sent DataPackets with their sizes, owned until completion
+    std::vector<DataPacket> dataPackets;
+    std::vector<char> headers;//DATAPACKET_HEADER_SIZE_MAX bytes per packet
+    std::vector<iovec> iov;
+    sockaddr_storage receiverAddr;
+
+    //Sent message, or address template of UDP receive
+    msghdr message;
+    std::uint64_t sendStartNanoseconds;//0 when histograms are disabled
+};
+
+
+///////////////////////////////////////////////
+struct sj::IOUring::Registration{
+    Kind kind;
+    std::uint64_t id;
+    API_RESERVED::Socket* socket;
+    void* userData;
+
+    //Only one send per client is in flight, so stream of packets stays ordered
+    Operation* sendInFlight;
+    std::vector<DataPacket> queuedPackets;
+
+    std::deque<int> acceptedFDs;
+};
+
+
+///////////////////////////////////////////////
+static sj::IOCompletion makeCompletion(const sj::IOCompletion::Type type, void* userData, const sj::Status status) {
+    sj::IOCompletion completion;
+    completion.type = type;
+    completion.userData = userData;
+    completion.status = status;
+    return completion;
+}
+
+
+///////////////////////////////////////////////
+sj::IOUring::IOUring(const unsigned entries) 
+    : ring(new Ring), nextID(1) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->ring_fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->ring_fd == -1)
+        return;
+
+    //Waiting with timeout needs EXT_ARG (Linux 5.11)
+    if((params.features & IORING_FEAT_EXT_ARG) == 0){
+        ring->close();
+        return;
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMmap)
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+
+    ring->sqRingPtr = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    ring->cqRingPtr = singleMmap ? ring->sqRingPtr : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqesPtr = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+    if(ring->sqRingPtr == MAP_FAILED || ring->cqRingPtr == MAP_FAILED || ring->sqesPtr == MAP_FAILED){
+        ring->close();
+        return;
+    }
+
+    char* const sqRing = (char*) ring->sqRingPtr;
+    ring->sqHead = (unsigned*) (sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned*) (sqRing + params.sq_off.tail);
+    ring->sqArray = (unsigned*) (sqRing + params.sq_off.array);
+    ring->sqMask = *(unsigned*) (sqRing + params.sq_off.ring_mask);
+    ring->sqEntries = *(unsigned*) (sqRing + params.sq_off.ring_entries);
+    ring->sqes = (io_uring_sqe*) ring->sqesPtr;
+
+    char* const cqRing = (char*) ring->cqRingPtr;
+    ring->cqHead = (unsigned*) (cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned*) (cqRing + params.cq_off.tail);
+    ring->cqMask = *(unsigned*) (cqRing + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe*) (cqRing + params.cq_off.cqes);
+
+    //Registered buffer ring (Linux 5.19) has to be page aligned
+    ring->bufferRingSize = IO_URING_BUFFERS_COUNT * sizeof(io_uring_buf);
+    ring->bufferRing = (io_uring_buf_ring*) mmap(nullptr, ring->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring->bufferRing == MAP_FAILED){
+        ring->close();
+        return;
+    }
+
+    io_uring_buf_reg bufferRingRegistration;
+    memset(&bufferRingRegistration, 0, sizeof(bufferRingRegistration));
+    bufferRingRegistration.ring_addr = (std::uint64_t) ring->bufferRing;
+    bufferRingRegistration.ring_entries = IO_URING_BUFFERS_COUNT;
+    bufferRingRegistration.bgid = IO_URING_BUFFER_GROUP;
+    if(syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &bufferRingRegistration, 1) == -1){
+        ring->close();
+        return;
+    }
+
+    ring->buffers.reset(new char[IO_URING_BUFFERS_COUNT * IO_URING_BUFFER_SIZE]);
+    for(unsigned short i = 0; i < IO_URING_BUFFERS_COUNT; i++)
+        ring->recycleBuffer(i);
+}
+
+
+///////////////////////////////////////////////
+sj::IOUring::~IOUring() {
+    for(auto& registration : registrations){
+        for(const int fd : registration.second->acceptedFDs)
+            ::close(fd);
+    }
+
+    //Ring is closed before operations are freed, 
+    //so kernel will not use memory of pending ones
+    ring->close();
+}
+
+
+///////////////////////////////////////////////
+bool sj::IOUring::isAvailable() {
+    return ring->ring_fd != -1;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::add(TCPClientSocket& clientSocket, void* userData) {
+    return add(clientSocket.socket, Kind::CLIENT, userData);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::add(TCPListenSocket& listenSocket, void* userData) {
+    return add(listenSocket.socket, Kind::LISTENER, userData);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::add(UDPSocket& udpSocket, void* userData) {
+    return add(udpSocket.socket, Kind::UDP, userData);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::remove(TCPClientSocket& clientSocket) {
+    return remove(clientSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::remove(TCPListenSocket& listenSocket) {
+    return remove(listenSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::remove(UDPSocket& udpSocket) {
+    return remove(udpSocket.socket);
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::send(TCPClientSocket& clientSocket, DataPacket&& dataPacket) {
+    auto registrationIt = registrations.find(clientSocket.socket.getFD());
+    if(registrationIt == registrations.end() || registrationIt->second->kind != Kind::CLIENT || dataPacket.size() > DATAPACKET_SIZE_MAX)
+        return Status::ERROR;
+
+    Registration& registration = *registrationIt->second;
+    registration.queuedPackets.push_back(std::move(dataPacket));
+    if(sendQueued(registration) == false)
+        return Status::ERROR;
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::sendTo(UDPSocket& udpSocket, DataPacket&& dataPacket, const Endpoint& receiver) {
+    auto registrationIt = registrations.find(udpSocket.socket.getFD());
+    if(registrationIt == registrations.end() || registrationIt->second->kind != Kind::UDP || dataPacket.size() > DATAPACKET_SIZE_MAX || receiver.isValid() == false)
+        return Status::ERROR;
+
+    //Every datagram is sent separately, order of them is not guaranteed anyway
+    Operation* const operation = createOperation(IOCompletion::Type::SEND, *registrationIt->second);
+    operation->dataPackets.push_back(std::move(dataPacket));
+    const size_t dataSize = operation->dataPackets[0].size();
+    operation->headers.resize(DATAPACKET_HEADER_SIZE_MAX);
+    operation->iov.resize(2);
+    operation->iov[0].iov_base = operation->headers.data();
+    operation->iov[0].iov_len = encodeDataPacketHeader(operation->dataPackets[0], operation->headers.data());
+    operation->iov[1].iov_base = (void*) operation->dataPackets[0].data();
+    operation->iov[1].iov_len = dataSize;
+
+    const socklen_t receiverAddrSize = receiver.toSockaddr(operation->receiverAddr);
+    memset(&operation->message, 0, sizeof(operation->message));
+    operation->message.msg_name = &operation->receiverAddr;
+    operation->message.msg_namelen = receiverAddrSize;
+    operation->message.msg_iov = operation->iov.data();
+    operation->message.msg_iovlen = dataSize != 0 ? 2 : 1;
+
+    if(submitSend(*operation) == false){
+        operations.erase(operation->id);
+        return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::acceptNewClient(TCPListenSocket& listenSocket, TCPClientSocket& newClient) {
+    auto registrationIt = registrations.find(listenSocket.socket.getFD());
+    if(registrationIt == registrations.end() || registrationIt->second->kind != Kind::LISTENER || newClient.isConnected())
+        return Status::ERROR;
+
+    std::deque<int>& acceptedFDs = registrationIt->second->acceptedFDs;
+    if(acceptedFDs.empty())
+        return Status::UNAVAILABLE;
+
+    newClient.socket.asignFD(acceptedFDs.front());
+    acceptedFDs.pop_front();
+    if(newClient.socket.inheritFrom(listenSocket.socket) != Status::OK){
+        newClient.socket.close();
+        return Status::ERROR;
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::wait(std::vector<IOCompletion>& completions, const int timeoutMs) {
+    if(isAvailable() == false)
+        return Status::ERROR;
+
+    //Completions waiting in full queue (EBUSY) are still reaped below
+    if(ring->enter(1, timeoutMs) == -1 && errno != ETIME && errno != EINTR && errno != EBUSY)
+        return Status::ERROR;
+
+    unsigned head = *ring->cqHead;
+    while(head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)){
+        const io_uring_cqe* const cqe = &ring->cqes[head & ring->cqMask];
+        const std::uint64_t operationID = cqe->user_data;
+        const std::int32_t result = cqe->res;
+        const std::uint32_t flags = cqe->flags;
+
+        //Entry is copied, so kernel can reuse it
+        head++;
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+        complete(operationID, result, flags, completions);
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::add(API_RESERVED::Socket& socket, const Kind kind, void* userData) {
+    if(isAvailable() == false || socket.getFD() == -1 || registrations.count(socket.getFD()) != 0)
+        return Status::ERROR;
+
+    std::unique_ptr<Registration> registration(new Registration);
+    registration->kind = kind;
+    registration->id = nextID++;
+    registration->socket = &socket;
+    registration->userData = userData;
+    registration->sendInFlight = nullptr;
+
+    Operation* const operation = createOperation(kind == Kind::LISTENER ? IOCompletion::Type::ACCEPT : IOCompletion::Type::RECEIVE, *registration);
+    const bool submitted = kind == Kind::LISTENER ? submitAccept(*operation, *registration) : submitReceive(*operation, *registration);
+    if(submitted == false){
+        operations.erase(operation->id);
+        return Status::ERROR;
+    }
+
+    registrations[socket.getFD()] = std::move(registration);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::IOUring::remove(API_RESERVED::Socket& socket) {
+    auto registrationIt = registrations.find(socket.getFD());
+    if(registrationIt == registrations.end())
+        return Status::ERROR;
+
+    //Cancellation is submitted at once, so socket can be closed after return.
+    //Registration stays when it fails, otherwise its operations would never be freed.
+    io_uring_sqe* const sqe = ring->nextSQE();
+    if(sqe == nullptr)
+        return Status::ERROR;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = socket.getFD();
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+
+    const unsigned cancelTail = *ring->sqTail;
+    while(ring->enter(0, -1) == -1 && errno == EINTR);
+    //Kernel moves head past every entry it took
+    if((int) (__atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) - cancelTail) < 0)
+        return Status::ERROR;
+
+    //Operations are freed when their cancellation completes
+    for(const int fd : registrationIt->second->acceptedFDs)
+        ::close(fd);
+    registrations.erase(registrationIt);
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::IOUring::Operation* sj::IOUring::createOperation(const IOCompletion::Type type, const Registration& registration) {
+    std::unique_ptr<Operation> operation(new Operation);
+    operation->type = type;
+    operation->id = nextID++;
+    operation->fd = registration.socket->getFD();
+    operation->registrationID = registration.id;
+    operation->sendStartNanoseconds = type == IOCompletion::Type::SEND ? sendStartNanoseconds() : 0;
+
+    Operation* const operationPtr = operation.get();
+    operations[operationPtr->id] = std::move(operation);
+    return operationPtr;
+}
+
+
+///////////////////////////////////////////////
+bool sj::IOUring::submitAccept(Operation& operation, const Registration& registration) {
+    io_uring_sqe* const sqe = ring->nextSQE();
+    if(sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = operation.fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = registration.socket->getMode() == Mode::NON_BLOCKING ? SOCK_NONBLOCK : 0;
+    sqe->user_data = operation.id;
+    return true;
+}
+
+
+///////////////////////////////////////////////
+bool sj::IOUring::submitReceive(Operation& operation, const Registration& registration) {
+    io_uring_sqe* const sqe = ring->nextSQE();
+    if(sqe == nullptr)
+        return false;
+
+    sqe->fd = operation.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IO_URING_BUFFER_GROUP;
+    sqe->user_data = operation.id;
+
+    //UDP needs sender address, which is placed before data in received buffer
+    if(registration.kind == Kind::UDP){
+        memset(&operation.message, 0, sizeof(operation.message));
+        operation.message.msg_namelen = sizeof(sockaddr_storage);
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->addr = (std::uint64_t) &operation.message;
+        sqe->len = 1;
+    }
+    else
+        sqe->opcode = IORING_OP_RECV;
+
+    return true;
+}
+
+
+///////////////////////////////////////////////
+bool sj::IOUring::submitSend(Operation& operation) {
+    io_uring_sqe* const sqe = ring->nextSQE();
+    if(sqe == nullptr)
+        return false;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = operation.fd;
+    sqe->addr = (std::uint64_t) &operation.message;
+    sqe->len = 1;
+    //Kernel retries short TCP sends by itself
+    sqe->msg_flags = MSG_NOSIGNAL | (operation.message.msg_name == nullptr ? MSG_WAITALL : 0);
+    sqe->user_data = operation.id;
+    return true;
+}
+
+
+///////////////////////////////////////////////
+bool sj::IOUring::sendQueued(Registration& registration) {
+    if(registration.sendInFlight != nullptr || registration.queuedPackets.empty())
+        return true;
+
+    //Two iovecs (size, data) per packet
+    const size_t maxPacketsPerMessage = IOV_MAX / 2;
+    Operation* const operation = createOperation(IOCompletion::Type::SEND, registration);
+    if(registration.queuedPackets.size() <= maxPacketsPerMessage)
+        operation->dataPackets.swap(registration.queuedPackets);
+    else{
+        auto lastSentIt = registration.queuedPackets.begin() + maxPacketsPerMessage;
+        operation->dataPackets.assign(std::make_move_iterator(registration.queuedPackets.begin()), std::make_move_iterator(lastSentIt));
+        registration.queuedPackets.erase(registration.queuedPackets.begin(), lastSentIt);
+    }
+
+    //All queued packets are sent with one message
+    const size_t packetsCount = operation->dataPackets.size();
+    operation->headers.resize(packetsCount * DATAPACKET_HEADER_SIZE_MAX);
+    operation->iov.reserve(packetsCount * 2);
+    for(size_t i = 0; i < packetsCount; i++){
+        const size_t dataSize = operation->dataPackets[i].size();
+        char* const header = operation->headers.data() + i * DATAPACKET_HEADER_SIZE_MAX;
+
+        iovec headerIov = {header, encodeDataPacketHeader(operation->dataPackets[i], header)};
+        operation->iov.push_back(headerIov);
+        if(dataSize != 0){
+            iovec dataIov = {(void*) operation->dataPackets[i].data(), dataSize};
+            operation->iov.push_back(dataIov);
+        }
+    }
+
+    memset(&operation->message, 0, sizeof(operation->message));
+    operation->message.msg_iov = operation->iov.data();
+    operation->message.msg_iovlen = operation->iov.size();
+
+    if(submitSend(*operation) == false){
+        operations.erase(operation->id);
+        return false;
+    }
+
+    registration.sendInFlight = operation;
+    return true;
+}
+
+
+///////////////////////////////////////////////
+void sj::IOUring::complete(const std::uint64_t operationID, const std::int32_t result, const std::uint32_t flags, std::vector<IOCompletion>& completions) {
+    auto operationIt = operations.find(operationID);
+    if(operationIt == operations.end())
+        return;
+
+    Operation& operation = *operationIt->second;
+    const bool more = (flags & IORING_CQE_F_MORE) != 0;
+    bool finished = more == false;
+    bool streamCorrupted = false;
+
+    //Socket could be removed (and its FD reused) before completion
+    auto registrationIt = registrations.find(operation.fd);
+    Registration* const registration = registrationIt != registrations.end() && registrationIt->second->id == operation.registrationID ? registrationIt->second.get() : nullptr;
+
+    switch(operation.type){
+        case IOCompletion::Type::ACCEPT:
+            if(result >= 0 && registration == nullptr)
+                ::close(result);
+            else if(result >= 0){
+                registration->acceptedFDs.push_back(result);
+                completions.push_back(makeCompletion(IOCompletion::Type::ACCEPT, registration->userData, Status::OK));
+            }
+            else if(registration != nullptr && result != -ECONNABORTED)
+                completions.push_back(makeCompletion(IOCompletion::Type::ACCEPT, registration->userData, Status::ERROR));
+
+            //Multishot accept can stop, it's restarted unless listening failed
+            if(finished && registration != nullptr && (result >= 0 || result == -ECONNABORTED))
+                finished = submitAccept(operation, *registration) == false;
+            break;
+
+        case IOCompletion::Type::RECEIVE:
+            if(flags & IORING_CQE_F_BUFFER){
+                const unsigned short bufferID = flags >> IORING_CQE_BUFFER_SHIFT;
+                const char* const buffer = ring->getBuffer(bufferID);
+
+                if(result > 0 && registration != nullptr){
+                    IOCompletion completion = makeCompletion(IOCompletion::Type::RECEIVE, registration->userData, Status::OK);
+
+                    if(registration->kind == Kind::UDP){
+                        //Buffer: header, sender address, packet
+                        const io_uring_recvmsg_out* const header = (const io_uring_recvmsg_out*) buffer;
+                        const char* const namePtr = buffer + sizeof(io_uring_recvmsg_out);
+                        const char* const payloadPtr = namePtr + operation.message.msg_namelen + operation.message.msg_controllen;
+                        const bool truncated = (header->flags & MSG_TRUNC) != 0;
+
+                        size_t receivedPackets = 0;
+                        if(truncated == false)
+                            registration->socket->appendReceived(payloadPtr, header->payloadlen, completion.dataPackets, &receivedPackets);
+
+                        //Datagrams joined by Option::RECEIVE_OFFLOAD bring many packets from the same sender
+                        if(receivedPackets != 0){
+                            sockaddr_storage addr;
+                            const size_t addrSize = std::min<size_t>(header->namelen, sizeof(addr));
+                            memset(&addr, 0, sizeof(addr));
+                            memcpy(&addr, namePtr, addrSize);
+                            Endpoint sender;
+                            sender.fromSockaddr(addr, addrSize);
+                            completion.senders.insert(completion.senders.end(), receivedPackets, sender);
+                        }
+                    }
+                    else{
+                        size_t receivedPackets = 0;
+                        streamCorrupted = registration->socket->appendReceived(buffer, result, completion.dataPackets, &receivedPackets) != Status::OK;
+                    }
+
+                    if(completion.dataPackets.empty() == false)
+                        completions.push_back(std::move(completion));
+                }
+
+                ring->recycleBuffer(bufferID);
+            }
+
+            //Connection closed by peer, receive failed or invalid packet header was received
+            if(registration != nullptr && (streamCorrupted || result == 0 || (result < 0 && result != -ENOBUFS && result != -ECANCELED)))
+                completions.push_back(makeCompletion(IOCompletion::Type::RECEIVE, registration->userData, Status::ERROR));
+
+            //Multishot receive stops when buffers run out, they are already recycled here
+            if(finished && registration != nullptr && (result > 0 || result == -ENOBUFS))
+                finished = submitReceive(operation, *registration) == false;
+            break;
+
+        case IOCompletion::Type::SEND:
+            if(registration == nullptr)
+                break;
+
+            if(result < 0){
+                //Stream is broken, rest of packets will not be sent
+                DataPacketPool::local().release(registration->queuedPackets);
+                registration->sendInFlight = nullptr;
+                completions.push_back(makeCompletion(IOCompletion::Type::SEND, registration->userData, Status::ERROR));
+                break;
+            }
+
+            if(registration->kind == Kind::CLIENT){
+                skipSentBytes(operation.message, result);
+                registration->socket->countSent(result, operation.message.msg_iovlen != 0);
+                if(operation.message.msg_iovlen != 0){
+                    finished = submitSend(operation) == false;
+                    if(finished == false)
+                        break;
+                }
+
+                registration->sendInFlight = nullptr;
+            }
+            else
+                registration->socket->countSent(result, false);
+
+            for(const DataPacket& dataPacket : operation.dataPackets)
+                registration->socket->countSentPacket(dataPacket.size());
+            if(operation.sendStartNanoseconds != 0)
+                registration->socket->countSendTime(sendStartNanoseconds() - operation.sendStartNanoseconds);
+
+            completions.push_back(makeCompletion(IOCompletion::Type::SEND, registration->userData, Status::OK));
+            sendQueued(*registration);
+            break;
+    }
+
+    if(finished){
+        //Memory of sent packets is reused for next ones
+        DataPacketPool::local().release(operation.dataPackets);
+        operations.erase(operationID);
+    }
+}
+
 ///////////////////////////////////////////////
-//  Socket class
+//  Reactor Class
 ///////////////////////////////////////////////
-sj::API_RESERVED::Socket::Socket(const Mode mode) 
-    : socket_fd(-1), mode(mode), dataPacketsBuffer(0) {
+sj::Reactor::Reactor() 
+    : waitingCount(0) {
 
 }
 
 
 ///////////////////////////////////////////////
-sj::API_RESERVED::Socket::~Socket() {
+sj::Reactor::~Reactor() {
 
 }
 
 
 ///////////////////////////////////////////////
-int sj::API_RESERVED::Socket::create(const Socket::Type type) {
-    socket_fd = ::socket(AF_INET, type == Type::TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
-    return socket_fd;
+sj::Status sj::Reactor::wait(TCPClientSocket& clientSocket, const Interest interest, Resume resume, void* waiter) {
+    return wait<TCPClientSocket>(clientSocket, interest, resume, waiter);
 }
 
 
 ///////////////////////////////////////////////
-int sj::API_RESERVED::Socket::bind(const short port) {
-    sockaddr_in addr;
-    addr.sin_port = htons(port);
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    return ::bind(socket_fd, (sockaddr*)&addr, sizeof(addr));
+sj::Status sj::Reactor::wait(TCPListenSocket& listenSocket, const Interest interest, Resume resume, void* waiter) {
+    return wait<TCPListenSocket>(listenSocket, interest, resume, waiter);
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::API_RESERVED::Socket::receiveInto(DataPacket& dataPacket) {
-    do{
-        //Check if already any bytes of packet is stored in buffer
-        if(dataPacketsBuffer.size() >= sizeof(DATAPACKET_SIZE_T)){
-            DATAPACKET_SIZE_T packetSizeInBuffer;//Packet size
-            
-            //Get packet size value
-            size_t currentByte = 0;
-            auto it = dataPacketsBuffer.begin();
-            while(currentByte < sizeof(packetSizeInBuffer)){
-                char* const packetSizeInBufferPtr = (char*) &packetSizeInBuffer;
-                *(packetSizeInBufferPtr + currentByte) = *it;
-
-                currentByte++;
-                it++;
-            }
-
-            //Check if whole packet is already in buffer...
-            if(packetSizeInBuffer >= (dataPacketsBuffer.size() - sizeof(packetSizeInBuffer)) ){
-                //... if it is, read it and exit receive function
-                while(currentByte < (packetSizeInBuffer + sizeof(packetSizeInBuffer))){
-                    dataPacket.data.push(*it);
-
-                    currentByte++;
-                    it++;
-                }
+sj::Status sj::Reactor::wait(UDPSocket& udpSocket, const Interest interest, Resume resume, void* waiter) {
+    return wait<UDPSocket>(udpSocket, interest, resume, waiter);
+}
 
-                dataPacketsBuffer.erase(dataPacketsBuffer.begin(), it);
-                return Status::OK;
-            }
+
+///////////////////////////////////////////////
+sj::Status sj::Reactor::runOnce(const int timeoutMs) {
+    readyEvents.clear();
+    Status status = poller.wait(readyEvents, timeoutMs);
+    if(status != Status::OK)
+        return status;
+
+    for(const PollEvent& readyEvent : readyEvents){
+        //Entries are never erased, so resumed waiters can't invalidate them
+        Waiters& socketWaiters = *static_cast<Waiters*>(readyEvent.userData);
+
+        if((readyEvent.readable || readyEvent.closed) && socketWaiters.reader != nullptr){
+            Resume resume = socketWaiters.reader;
+            socketWaiters.reader = nullptr;
+            waitingCount--;
+            resume(socketWaiters.readerData);
         }
 
-        //if buffor dont have full packet in it,
-        //try to receive some data to it
-        std::array<char, DATAPACKET_SIZE_T_MAX + sizeof(DATAPACKET_SIZE_T)> receiveBuffor;
-        size_t readedBytes = 0;
-        Status status = receiveInto(receiveBuffor.data(), receiveBuffor.max_size(), &readedBytes);
-        if(status != Status::OK)//When mode is non-blocking, function return here
+        if((readyEvent.writable || readyEvent.closed) && socketWaiters.writer != nullptr){
+            Resume resume = socketWaiters.writer;
+            socketWaiters.writer = nullptr;
+            waitingCount--;
+            resume(socketWaiters.writerData);
+        }
+    }
+
+    return Status::OK;
+}
+
+
+///////////////////////////////////////////////
+sj::Status sj::Reactor::run() {
+    while(waitingCount != 0){
+        Status status = runOnce();
+        if(status != Status::OK)
             return status;
+    }
 
-        std::copy_n(receiveBuffor.begin(), readedBytes-1, dataPacketsBuffer.end());
-    } while(true);//Repeat until any full packet will be available in packet buffor
+    return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::API_RESERVED::Socket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
-    const ssize_t recvStatus = recv(socket_fd, buffer, bufferSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
+size_t sj::Reactor::getWaitingCount() {
+    return waitingCount;
+}
 
-    if(recvStatus == -1){
-        *readedBytes = 0;
 
-        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK))
-            return Status::UNAVAILABLE;
+///////////////////////////////////////////////
+template<typename SocketType>
+sj::Status sj::Reactor::wait(SocketType& socket, const Interest interest, Resume resume, void* waiter) {
+    const int fd = socket.socket.getFD();
+    if(fd == -1 || resume == nullptr || interest == Interest::READ_WRITE)
+        return Status::ERROR;
 
+    Waiters& socketWaiters = waiters[fd];
+    Resume& slot = interest == Interest::READ ? socketWaiters.reader : socketWaiters.writer;
+    if(slot != nullptr)
         return Status::ERROR;
+
+    //Edge triggered registration for both directions is rearmed before every wait,
+    //which reports readiness gained since last operation. Modify fails when FD was closed
+    //(epoll forgets it) and reused by other socket, then it's added again.
+    if(socketWaiters.registered == false || poller.modify(socket, Interest::READ_WRITE, Trigger::EDGE) != Status::OK){
+        socketWaiters.registered = poller.add(socket, Interest::READ_WRITE, Trigger::EDGE, &socketWaiters) == Status::OK;
+        if(socketWaiters.registered == false)
+            return Status::ERROR;
     }
 
-    *readedBytes = recvStatus;
+    slot = resume;
+    (interest == Interest::READ ? socketWaiters.readerData : socketWaiters.writerData) = waiter;
+    waitingCount++;
     return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::API_RESERVED::Socket::sendTo(DataPacket& dataPacket, const std::string* ipAddress, const short port) {
-    const DATAPACKET_SIZE_T dataSize = (DATAPACKET_SIZE_T) dataPacket.data.size();
-    std::vector<char> buffer(dataSize);
-
-    //Put packet size into buffer
-    memcpy(buffer.data(), &dataSize, sizeof(dataSize));
-    //Put packet data into buffer
-    for(size_t i=0; i < dataPacket.data.size(); i++){
-        buffer[i + sizeof(dataSize)] = dataPacket.data.front();
-        dataPacket.data.pop();
-    }
+//  TCPServer Class
+///////////////////////////////////////////////
+struct sj::TCPServer::Task{
+    enum struct Kind{
+        HANDLE,//Received 'requests' are handled on worker, 'responses' are sent when it's back
+        SEND,//'responses' are sent
+        DISCONNECT
+    };
+
+    Task() : kind(Kind::HANDLE), connection(0) {}
+
+    Kind kind;
+    ConnectionID connection;
+    std::vector<DataPacket> requests;
+    std::vector<DataPacket> responses;
+};
 
-    return sendTo(buffer.data(), buffer.size(), ipAddress, port);
-}
 
+//Bounded queue for many producers and consumers (Vyukov). Sequence number of every cell 
+//tells whether it's free for position being pushed or filled for position being popped.
+struct sj::TCPServer::TaskQueue{
+    struct Cell{
+        std::atomic<size_t> sequence;
+        Task* task;
+    };
 
-///////////////////////////////////////////////
-sj::Status sj::API_RESERVED::Socket::sendTo(const void* data, const size_t dataSize, const std::string* ipAddress, const short port) {
+    TaskQueue(const size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1), pushPosition(0), popPosition(0) {
+        for(size_t i = 0; i < capacity; i++){
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+            cells[i].task = nullptr;
+        }
+    }
 
-    ssize_t sendStatus = -1;
-    //UDP with receiver IP addres
-    if(ipAddress != nullptr && port != -1){
-        sockaddr_in addr;
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        if(inet_aton(ipAddress->c_str(), &addr.sin_addr) == -1){
-            close();
-            return Status::ERROR;
+    //False when queue is full
+    bool push(Task* task){
+        size_t position = pushPosition.load(std::memory_order_relaxed);
+        while(true){
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t difference = (std::intptr_t) sequence - (std::intptr_t) position;
+            if(difference == 0){
+                if(pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    cell.task = task;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(difference < 0)
+                return false;
+            else
+                position = pushPosition.load(std::memory_order_relaxed);
         }
-        sendStatus = ::sendto(socket_fd, data, dataSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0, (sockaddr*) &addr, sizeof(addr));
     }
-    //TCP with connected receiver
-    else
-        sendStatus = ::send(socket_fd, data, dataSize, mode == Mode::NON_BLOCKING ? MSG_DONTWAIT : 0);
 
-    if(sendStatus == -1){
-        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK))
-            return Status::UNAVAILABLE;
+    //nullptr when queue is empty
+    Task* pop(){
+        size_t position = popPosition.load(std::memory_order_relaxed);
+        while(true){
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t difference = (std::intptr_t) sequence - (std::intptr_t) (position + 1);
+            if(difference == 0){
+                if(popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    Task* task = cell.task;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return task;
+                }
+            }
+            else if(difference < 0)
+                return nullptr;
+            else
+                position = popPosition.load(std::memory_order_relaxed);
+        }
+    }
 
-        return Status::ERROR;
+    //Task being pushed counts already, so sleeping thread is not missing it
+    bool isEmpty(){
+        return pushPosition.load(std::memory_order_seq_cst) == popPosition.load(std::memory_order_seq_cst);
     }
-    
-    return Status::OK;
-}
 
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> pushPosition;
+    char padding[64];//Producers and consumers do not share cache line
+    std::atomic<size_t> popPosition;
+};
 
-///////////////////////////////////////////////
-int sj::API_RESERVED::Socket::getFD() {
-    return socket_fd;
-}
 
+struct sj::TCPServer::Connection{
+    Connection(const ConnectionID id) : id(id), client(Mode::NON_BLOCKING), registeredInterest(0), handling(false), closing(false), broken(false) {}
 
-///////////////////////////////////////////////
-void sj::API_RESERVED::Socket::asignFD(const int fd) {
-    socket_fd = fd;
-}
+    ConnectionID id;
+    TCPClientSocket client;
+    int registeredInterest;//Interest bits in poller, 0 when removed from it
+    bool handling;//Task with its DataPackets was given to worker
+    bool closing;//Disconnect was requested or peer hung up
+    bool broken;//Socket failed, nothing can be sent
+    std::vector<DataPacket> received;//Waiting for current task
+    std::vector<DataPacket> unsent;//Waiting for space in socket buffer
+};
 
 
-///////////////////////////////////////////////
-sj::Mode sj::API_RESERVED::Socket::getMode() {
-    return mode;
-}
+struct sj::TCPServer::IOThread{
+    IOThread(const size_t index, const size_t queueCapacity) 
+        : index(index), completions(queueCapacity), sleeping(false), started(0), nextConnection(0), nextWorker(0),
+          connectionsCount(0), handledPackets(0), tasks(0), inlineTasks(0) {}
+
+    size_t index;
+    std::thread thread;
+    Poller poller;
+    TaskQueue completions;//Handled tasks, sends and disconnects from other threads
+    std::atomic<bool> sleeping;//Waits in poller, so pushing to 'completions' has to wake it
+    std::atomic<int> started;//0 while starting, 1 when running, -1 when it failed
+    std::unordered_map<ConnectionID, std::unique_ptr<Connection>> connections;
+    std::vector<std::unique_ptr<Task>> freeTasks;
+    std::vector<PollEvent> events;
+    std::uint64_t nextConnection;
+    size_t nextWorker;
+
+    //Written only by this thread
+    std::atomic<std::uint64_t> connectionsCount;
+    std::atomic<std::uint64_t> handledPackets;
+    std::atomic<std::uint64_t> tasks;
+    std::atomic<std::uint64_t> inlineTasks;
+};
+
+
+struct sj::TCPServer::Worker{
+    Worker(const size_t index, const size_t queueCapacity) : index(index), tasks(queueCapacity), started(0), stolenTasks(0) {}
+
+    size_t index;
+    std::thread thread;
+    TaskQueue tasks;
+    std::atomic<int> started;//0 while starting, 1 when running, -1 when it failed
+    std::atomic<std::uint64_t> stolenTasks;
+};
 
 
 ///////////////////////////////////////////////
-int sj::API_RESERVED::Socket::close() {
-    const int closeValue = ::close(socket_fd);
-    if(closeValue != -1)
-        socket_fd = -1;
+sj::TCPServer::TCPServer(const TCPServerConfig& config) 
+    : config(config), running(false), workSignal(0), sleepingWorkers(0) {
 
-    return closeValue;
 }
 
 
 ///////////////////////////////////////////////
-//  TCPClientSocket Class
-///////////////////////////////////////////////
-sj::TCPClientSocket::TCPClientSocket(const Mode mode) 
-    : socket(mode) {
+sj::TCPServer::~TCPServer() {
+    if(isRunning())
+        stop();
+}
 
+
+///////////////////////////////////////////////
+void sj::TCPServer::setConnectCallback(ConnectionCallback callback) {
+    connectCallback = std::move(callback);
 }
 
 
 ///////////////////////////////////////////////
-sj::TCPClientSocket::~TCPClientSocket() {
-    disconnect();
+void sj::TCPServer::setDisconnectCallback(ConnectionCallback callback) {
+    disconnectCallback = std::move(callback);
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::connect(const std::string& ipAddress, const short port) {
-    if(isConnected())
+sj::Status sj::TCPServer::start(const short port, Handler handler) {
+    if(isRunning() || !handler || config.ioThreads == 0 || config.ioThreads > TCP_SERVER_IO_THREADS_MAX || config.queueCapacity == 0)
         return Status::ERROR;
-
-    if(socket.create(Socket::Type::TCP) == -1)
+    if((config.ioThreadCpus.empty() == false && config.ioThreadCpus.size() != config.ioThreads) || 
+        (config.workerThreadCpus.empty() == false && config.workerThreadCpus.size() != config.workerThreads))
         return Status::ERROR;
 
-    sockaddr_in addr;
-    addr.sin_port = htons(port);
-    addr.sin_family = AF_INET;
-    if(inet_aton(ipAddress.c_str(), &addr.sin_addr) == -1){
-        socket.close();
+    listenSocket.reset(new TCPShardedListenSocket(Mode::NON_BLOCKING, config.ioThreads));
+    if(listenSocket->beginListening(port, config.backlog) != Status::OK){
+        listenSocket.reset();
         return Status::ERROR;
     }
 
-    if(::connect(socket.getFD(), (sockaddr*)&addr, sizeof(addr)) == -1){
-        socket.close();
+    this->handler = std::move(handler);
+    size_t queueCapacity = 1;
+    while(queueCapacity < config.queueCapacity)
+        queueCapacity <<= 1;
+
+    //Threads reach queues of each other, so all of them exist before first thread starts
+    running = true;
+    for(size_t i = 0; i < config.ioThreads; i++)
+        ioThreads.emplace_back(new IOThread(i, queueCapacity));
+    for(size_t i = 0; i < config.workerThreads; i++)
+        workers.emplace_back(new Worker(i, queueCapacity));
+    for(auto& ioThread : ioThreads)
+        ioThread->thread = std::thread(&TCPServer::runIOThread, this, std::ref(*ioThread));
+    for(auto& worker : workers)
+        worker->thread = std::thread(&TCPServer::runWorker, this, std::ref(*worker));
+
+    bool started = true;
+    for(auto& ioThread : ioThreads){
+        while(ioThread->started.load() == 0)
+            std::this_thread::yield();
+        started = started && ioThread->started.load() == 1;
+    }
+    for(auto& worker : workers){
+        while(worker->started.load() == 0)
+            std::this_thread::yield();
+        started = started && worker->started.load() == 1;
+    }
+
+    if(started == false){
+        stop();
         return Status::ERROR;
     }
 
@@ -386,226 +6267,421 @@ sj::Status sj::TCPClientSocket::connect(const std::string& ipAddress, const shor
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::disconnect() {
-    if(isConnected() == false)
+sj::Status sj::TCPServer::stop() {
+    if(running.exchange(false) == false)
         return Status::ERROR;
 
-    Status returnStatus = Status::OK;
-    
-    if(shutdown(socket.getFD(), SHUT_RDWR) == -1)
-        returnStatus = Status::ERROR;
+    for(auto& ioThread : ioThreads)
+        ioThread->poller.wake();
+    futexWake(workSignal);
 
-    if(socket.close() == -1)
-        returnStatus = Status::ERROR;
+    for(auto& worker : workers)
+        worker->thread.join();
+    for(auto& ioThread : ioThreads)
+        ioThread->thread.join();
 
-    return returnStatus;
+    //Left in queues when threads ended
+    Task* task;
+    for(auto& worker : workers){
+        while((task = worker->tasks.pop()) != nullptr)
+            delete task;
+    }
+    for(auto& ioThread : ioThreads){
+        while((task = ioThread->completions.pop()) != nullptr)
+            delete task;
+    }
+
+    workers.clear();
+    ioThreads.clear();
+    listenSocket.reset();
+    return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::send(DataPacket& dataPacket) {
-    if(isConnected() == false)
-        return Status::ERROR;
-
-    return socket.sendTo(dataPacket);
+bool sj::TCPServer::isRunning() {
+    return running.load();
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::send(const void* data, const size_t dataSize) {
-    if(isConnected() == false)
+sj::Status sj::TCPServer::send(const ConnectionID connection, DataPacket&& dataPacket) {
+    const size_t ioThread = connection & (TCP_SERVER_IO_THREADS_MAX - 1);
+    if(isRunning() == false || ioThread >= ioThreads.size())
         return Status::ERROR;
 
-    return socket.sendTo(data, dataSize);
+    std::unique_ptr<Task> task(new Task());
+    task->kind = Task::Kind::SEND;
+    task->connection = connection;
+    task->responses.push_back(std::move(dataPacket));
+    if(pushCompletion(*ioThreads[ioThread], task.get()) != Status::OK){
+        dataPacket = std::move(task->responses.front());
+        return Status::UNAVAILABLE;
+    }
+
+    task.release();
+    return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::receiveInto(DataPacket& dataPacket) {
-    if(isConnected() == false)
+sj::Status sj::TCPServer::disconnect(const ConnectionID connection) {
+    const size_t ioThread = connection & (TCP_SERVER_IO_THREADS_MAX - 1);
+    if(isRunning() == false || ioThread >= ioThreads.size())
         return Status::ERROR;
 
-    return socket.receiveInto(dataPacket);
+    std::unique_ptr<Task> task(new Task());
+    task->kind = Task::Kind::DISCONNECT;
+    task->connection = connection;
+    if(pushCompletion(*ioThreads[ioThread], task.get()) != Status::OK)
+        return Status::UNAVAILABLE;
+
+    task.release();
+    return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPClientSocket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
-    if(isConnected() == false)
-        return Status::ERROR;
+sj::TCPServerStats sj::TCPServer::getStats() {
+    TCPServerStats stats = TCPServerStats();
+    if(listenSocket)
+        stats.sockets = listenSocket->getStats();
+
+    for(auto& ioThread : ioThreads){
+        stats.connections += ioThread->connectionsCount.load(std::memory_order_relaxed);
+        stats.handledPackets += ioThread->handledPackets.load(std::memory_order_relaxed);
+        stats.tasks += ioThread->tasks.load(std::memory_order_relaxed);
+        stats.inlineTasks += ioThread->inlineTasks.load(std::memory_order_relaxed);
+    }
+    for(auto& worker : workers)
+        stats.stolenTasks += worker->stolenTasks.load(std::memory_order_relaxed);
 
-    return socket.receiveInto(buffer, bufferSize, readedBytes);
+    return stats;
 }
 
 
 ///////////////////////////////////////////////
-bool sj::TCPClientSocket::isConnected() {
-    return socket.getFD() != -1;
-}
+void sj::TCPServer::runIOThread(IOThread& ioThread) {
+    TCPListenSocket& shard = listenSocket->getShard(ioThread.index);
+    bool started = ioThread.poller.add(shard, Interest::READ, Trigger::LEVEL, &shard) == Status::OK;
+    if(started && config.ioThreadCpus.empty() == false)
+        started = listenSocket->pinShard(ioThread.index, config.ioThreadCpus[ioThread.index]) == Status::OK;
+
+    ioThread.started = started ? 1 : -1;
+    if(started == false)
+        return;
+
+    while(running.load(std::memory_order_acquire)){
+        //Flag is set before queue is checked, so task pushed after the check wakes poller
+        ioThread.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int timeoutMs = ioThread.completions.isEmpty() ? -1 : 0;
+
+        ioThread.events.clear();
+        const Status status = ioThread.poller.wait(ioThread.events, timeoutMs);
+        ioThread.sleeping.store(false, std::memory_order_relaxed);
+        if(status != Status::OK)
+            break;
+
+        for(const PollEvent& event : ioThread.events){
+            if(event.userData == &shard){
+                acceptClients(ioThread);
+                continue;
+            }
 
+            Connection& connection = *static_cast<Connection*>(event.userData);
+            if(event.writable)
+                flush(connection);
+            if((event.readable || event.closed) && connection.closing == false)
+                receive(ioThread, connection);
+            update(ioThread, connection);
+        }
 
-///////////////////////////////////////////////
-//  TCPListenSocket Class
-///////////////////////////////////////////////
-sj::TCPListenSocket::TCPListenSocket(const Mode mode) 
-    : socket(mode) {
+        //Bounded, so other threads pushing all the time do not starve sockets
+        Task* task;
+        for(size_t i = 0; i <= ioThread.completions.mask && (task = ioThread.completions.pop()) != nullptr; i++){
+            Connection* connection = complete(ioThread, *task);
+            if(connection != nullptr)
+                update(ioThread, *connection);
+        }
+    }
 
+    ioThread.poller.remove(shard);
+    while(ioThread.connections.empty() == false)
+        closeConnection(ioThread, *ioThread.connections.begin()->second);
 }
 
 
 ///////////////////////////////////////////////
-sj::TCPListenSocket::~TCPListenSocket() {
-    endListening();
+void sj::TCPServer::runWorker(Worker& worker) {
+    const bool started = config.workerThreadCpus.empty() || pinCurrentThread(config.workerThreadCpus[worker.index]);
+    worker.started = started ? 1 : -1;
+    if(started == false)
+        return;
+
+    while(running.load(std::memory_order_acquire)){
+        Task* task = worker.tasks.pop();
+        if(task == nullptr && (task = stealTask(worker.index)) != nullptr)
+            worker.stolenTasks.fetch_add(1, std::memory_order_relaxed);
+
+        if(task != nullptr){
+            handle(*task);
+
+            //Queue of I/O thread is full only when it's overloaded, then this worker waits for it
+            IOThread& ioThread = *ioThreads[task->connection & (TCP_SERVER_IO_THREADS_MAX - 1)];
+            while(pushCompletion(ioThread, task) != Status::OK){
+                if(running.load(std::memory_order_acquire) == false){
+                    delete task;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        //Counted as sleeping before queues are checked again, so task pushed after the check wakes it
+        const std::uint32_t signal = workSignal.load();
+        sleepingWorkers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool idle = running.load();
+        for(size_t i = 0; i < workers.size() && idle; i++)
+            idle = workers[i]->tasks.isEmpty();
+        if(idle)
+            futexWait(workSignal, signal);
+        sleepingWorkers.fetch_sub(1);
+    }
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPListenSocket::beginListening(const short port) {
-    if(isListening())
-        return Status::ERROR;
-
-    if(socket.create(Socket::Type::TCP) == -1) 
-        return Status::ERROR;
-
-    if(socket.bind(port) == -1){
-        socket.close();
-        return Status::ERROR;
-    }
-    
-    const size_t maxListenConnections = SOMAXCONN;//128
-    if(listen(socket.getFD(), maxListenConnections) == -1){
-        socket.close();
-        return Status::ERROR;
+void sj::TCPServer::acceptClients(IOThread& ioThread) {
+    TCPListenSocket& shard = listenSocket->getShard(ioThread.index);
+    while(true){
+        const ConnectionID id = (ioThread.nextConnection++ << TCP_SERVER_IO_THREAD_BITS) | ioThread.index;
+        std::unique_ptr<Connection> connection(new Connection(id));
+        if(shard.acceptNewClient(connection->client) != Status::OK)
+            return;
+        if(ioThread.poller.add(connection->client, Interest::READ, Trigger::LEVEL, connection.get()) != Status::OK)
+            continue;
+
+        connection->registeredInterest = (int) Interest::READ;
+        ioThread.connections[id] = std::move(connection);
+        ioThread.connectionsCount.fetch_add(1, std::memory_order_relaxed);
+        if(connectCallback)
+            connectCallback(id);
     }
-
-    return Status::OK;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPListenSocket::endListening() {
-    if(isListening() == false)
-        return Status::ERROR;
-
-    Status returnStatus = Status::OK;
-    
-    if(::shutdown(socket.getFD(), SHUT_RDWR) == -1)
-        returnStatus = Status::ERROR;
-
-    if(socket.close() == -1)
-        returnStatus = Status::ERROR;
+void sj::TCPServer::receive(IOThread& ioThread, Connection& connection) {
+    size_t receivedPackets;
+    if(connection.client.receiveInto(connection.received, &receivedPackets) == Status::ERROR){
+        connection.closing = true;
+        connection.broken = true;
+        return;
+    }
 
-    return returnStatus;
+    if(connection.received.empty() == false && connection.handling == false)
+        dispatch(ioThread, connection);
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::TCPListenSocket::acceptNewClient(TCPClientSocket& newClient) {
-    if(isListening() == false || newClient.isConnected())
-        return Status::ERROR;
-
-    Mode mode = socket.getMode();
-    const int acceptStatus = accept4(socket.getFD(), NULL, NULL, mode == Mode::NON_BLOCKING ? SOCK_NONBLOCK : 0);
-
-    if(acceptStatus == -1){
-        if(mode == Mode::NON_BLOCKING && (errno == EAGAIN || errno == EWOULDBLOCK))
-            return Status::UNAVAILABLE;
+void sj::TCPServer::dispatch(IOThread& ioThread, Connection& connection) {
+    std::unique_ptr<Task> task;
+    if(ioThread.freeTasks.empty()){
+        task.reset(new Task());
+    }
+    else{
+        task = std::move(ioThread.freeTasks.back());
+        ioThread.freeTasks.pop_back();
+    }
 
-        return Status::ERROR;
+    //Only one task of connection exists at a time, so its DataPackets are handled in order
+    task->kind = Task::Kind::HANDLE;
+    task->connection = connection.id;
+    task->requests.swap(connection.received);
+    connection.handling = true;
+
+    //Every I/O thread prefers its own group of workers (they share CPUs when pinned),
+    //other ones are tried when all queues of the group are full
+    if(workers.empty() == false){
+        const size_t groupSize = std::max<size_t>(1, workers.size() / ioThreads.size());
+        const size_t first = ioThread.index + (ioThread.nextWorker++ % groupSize) * ioThreads.size();
+        for(size_t i = 0; i < workers.size(); i++){
+            if(workers[(first + i) % workers.size()]->tasks.push(task.get())){
+                task.release();
+                wakeWorker();
+                return;
+            }
+        }
     }
 
-    newClient.socket.asignFD(acceptStatus);
-    return Status::OK;
+    handle(*task);
+    ioThread.inlineTasks.fetch_add(1, std::memory_order_relaxed);
+    complete(ioThread, *task.release());
 }
 
 
 ///////////////////////////////////////////////
-bool sj::TCPListenSocket::isListening() {
-    return socket.getFD() != -1;
+void sj::TCPServer::handle(Task& task) {
+    for(DataPacket& request : task.requests)
+        handler(task.connection, request, task.responses);
 }
 
 
 ///////////////////////////////////////////////
-//  UDPSocket Class
-///////////////////////////////////////////////
-sj::UDPSocket::UDPSocket(const Mode mode) 
-    : socket(mode) {
+sj::TCPServer::Connection* sj::TCPServer::complete(IOThread& ioThread, Task& task) {
+    std::unique_ptr<Task> finishedTask(&task);
+    auto connectionIt = ioThread.connections.find(task.connection);
+    Connection* connection = connectionIt != ioThread.connections.end() ? connectionIt->second.get() : nullptr;
+
+    if(connection != nullptr){
+        if(task.kind == Task::Kind::HANDLE){
+            connection->handling = false;
+            ioThread.handledPackets.fetch_add(task.requests.size(), std::memory_order_relaxed);
+            ioThread.tasks.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if(task.kind == Task::Kind::DISCONNECT){
+            connection->closing = true;
+        }
 
-}
+        if(connection->broken == false){
+            if(connection->unsent.empty())
+                connection->unsent.swap(task.responses);
+            else
+                std::move(task.responses.begin(), task.responses.end(), std::back_inserter(connection->unsent));
+            flush(*connection);
+        }
 
+        if(connection->handling == false && connection->closing == false && connection->received.empty() == false)
+            dispatch(ioThread, *connection);
+    }
 
-///////////////////////////////////////////////
-sj::UDPSocket::~UDPSocket() {
-    unbind();
+    //DataPackets return to pool of I/O thread, which acquires them for receiving
+    DataPacketPool& pool = DataPacketPool::local();
+    pool.release(task.requests);
+    pool.release(task.responses);
+    if(ioThread.freeTasks.size() <= ioThread.completions.mask)
+        ioThread.freeTasks.push_back(std::move(finishedTask));
+
+    return connection;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::bind(const short port) {
-    if(isBinded())
-        return Status::ERROR;
-
-    if(socket.create(Socket::Type::UDP) == -1) 
-        return Status::ERROR;
-
-    if(socket.bind(port) == -1){
-        socket.close();
-        return Status::ERROR;
+void sj::TCPServer::flush(Connection& connection) {
+    if(connection.broken)
+        return;
+
+    //Rest of partially sent DataPackets goes first, also inside 'send'
+    Status status;
+    if(connection.unsent.empty())
+        status = connection.client.flush();
+    else{
+        //Sends all DataPackets or none of them
+        status = connection.client.send(connection.unsent);
+        if(status != Status::UNAVAILABLE)
+            DataPacketPool::local().release(connection.unsent);
     }
 
-    return Status::OK;
+    if(status == Status::ERROR){
+        connection.closing = true;
+        connection.broken = true;
+    }
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::unbind() {
-    if(isBinded() == false)
-        return Status::ERROR;
-
-    if(socket.close())
-        return Status::ERROR;
+void sj::TCPServer::update(IOThread& ioThread, Connection& connection) {
+    const bool sending = connection.unsent.empty() == false || connection.client.getUnsentBytes() != 0;
+    if(connection.closing && connection.handling == false && (sending == false || connection.broken)){
+        closeConnection(ioThread, connection);
+        return;
+    }
 
-    return Status::OK;
+    //Reading stops while many DataPackets wait, so client is slowed down by TCP
+    int interest = 0;
+    if(connection.broken == false){
+        if(connection.closing == false && connection.received.size() < TCP_SERVER_PENDING_MAX && connection.unsent.size() < TCP_SERVER_PENDING_MAX)
+            interest |= (int) Interest::READ;
+        if(sending)
+            interest |= (int) Interest::WRITE;
+    }
+    if(interest == connection.registeredInterest)
+        return;
+
+    Status status;
+    if(interest == 0)
+        status = ioThread.poller.remove(connection.client);
+    else if(connection.registeredInterest == 0)
+        status = ioThread.poller.add(connection.client, (Interest) interest, Trigger::LEVEL, &connection);
+    else
+        status = ioThread.poller.modify(connection.client, (Interest) interest);
+
+    connection.registeredInterest = interest;
+    if(status != Status::OK){
+        connection.closing = true;
+        connection.broken = true;
+        if(connection.handling == false)
+            closeConnection(ioThread, connection);
+    }
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::sendTo(DataPacket& dataPacket, const std::string& ipAddress, const short port) {
-    if(isBinded() == false)
-        return Status::ERROR;
-
-    return socket.sendTo(dataPacket, &ipAddress, port);
+void sj::TCPServer::closeConnection(IOThread& ioThread, Connection& connection) {
+    const ConnectionID id = connection.id;
+    if(connection.registeredInterest != 0)
+        ioThread.poller.remove(connection.client);
+    connection.client.disconnect();
+
+    DataPacketPool& pool = DataPacketPool::local();
+    pool.release(connection.received);
+    pool.release(connection.unsent);
+    ioThread.connections.erase(id);
+    ioThread.connectionsCount.fetch_sub(1, std::memory_order_relaxed);
+    if(disconnectCallback)
+        disconnectCallback(id);
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::sendTo(const void* data, const size_t dataSize, const std::string& ipAddress, const short port) {
-    if(isBinded() == false)
-        return Status::ERROR;
+sj::TCPServer::Task* sj::TCPServer::stealTask(const size_t thief) {
+    for(size_t i = 1; i < workers.size(); i++){
+        Task* task = workers[(thief + i) % workers.size()]->tasks.pop();
+        if(task != nullptr)
+            return task;
+    }
 
-    return socket.sendTo(data, dataSize, &ipAddress, port);
+    return nullptr;
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::receiveInto(DataPacket& dataPacket) {
-    if(isBinded() == false)
-        return Status::ERROR;
-
-    return socket.receiveInto(dataPacket);
+void sj::TCPServer::wakeIOThread(IOThread& ioThread) {
+    //Pairs with fence in 'runIOThread', either poller sees the task or this sees sleeping flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(ioThread.sleeping.load(std::memory_order_relaxed) && ioThread.sleeping.exchange(false))
+        ioThread.poller.wake();
 }
 
 
 ///////////////////////////////////////////////
-sj::Status sj::UDPSocket::receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes) {
-    if(isBinded() == false)
-        return Status::ERROR;
-
-    return socket.receiveInto(buffer, bufferSize, readedBytes);
+void sj::TCPServer::wakeWorker() {
+    //Pairs with fence in 'runWorker', busy workers are not woken by syscall
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleepingWorkers.load(std::memory_order_relaxed) != 0)
+        futexWake(workSignal, 1);
 }
 
 
 ///////////////////////////////////////////////
-bool sj::UDPSocket::isBinded() {
-    return socket.getFD() != -1;
-}
\ No newline at end of file
+sj::Status sj::TCPServer::pushCompletion(IOThread& ioThread, Task* task) {
+    if(ioThread.completions.push(task) == false)
+        return Status::UNAVAILABLE;
+
+    wakeIOThread(ioThread);
+    return Status::OK;
+}
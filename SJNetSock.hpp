@@ -19,9 +19,39 @@
 #pragma once
 
 #include <string>
-#include <queue>
-#include <list>
+#include <memory>
+#include <cstring>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <functional>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#if __cplusplus >= 202002L
+#include <span>
+#include <coroutine>
+#include <exception>
+#endif
+
+struct msghdr;
+struct sockaddr_storage;
+
+//Lists fields of struct sent with DataPacket as one fixed size block
+//('packet << value', 'packet >> value'). Has to be placed after listed fields.
+//Example: struct Position{ int32_t x, y; SJ_DATAPACKET_FIELDS(x, y) };
+#define SJ_DATAPACKET_FIELDS(...) \
+    typedef void DataPacketFieldsTag; \
+    template<typename Visitor> \
+    auto visitDataPacketFields(Visitor&& visitor) -> decltype(visitor(__VA_ARGS__)) { return visitor(__VA_ARGS__); } \
+    template<typename Visitor> \
+    auto visitDataPacketFields(Visitor&& visitor) const -> decltype(visitor(__VA_ARGS__)) { return visitor(__VA_ARGS__); }
 
 namespace sj{
 
@@ -40,17 +70,263 @@ enum struct Mode{
     NON_BLOCKING
 };
 
-namespace API_RESERVED { class Socket; }
+enum struct Option{
+    NO_DELAY,//TCP only, 1 disables Nagle algorithm, so small packets are sent at once
+    QUICK_ACK,//TCP only, 1 sends ACKs immediately instead of delaying them
+    RECEIVE_BUFFER_SIZE,//Kernel receive buffer in bytes
+    SEND_BUFFER_SIZE,//Kernel send buffer in bytes
+    BUSY_POLL,//Microseconds of busy polling device queue when receiving, 0 disables it
+    ZERO_COPY,//TCP only, 1 lets 'sendZeroCopy' pass big buffers to network card without copying them
+    SEGMENTATION_OFFLOAD,//UDP only, 1 lets 'sendBatch' pass same-sized DataPackets as one buffer, which is split into datagrams by kernel or network card (GSO)
+    RECEIVE_OFFLOAD,//UDP only, 1 lets kernel deliver datagrams of one sender joined together (GRO), they are split again on receive
+    REUSE_ADDRESS,//1 lets more sockets bind the same address (e.g. multicast subscribers on one host), has to be set before 'bind'
+    MULTICAST_TTL,//UDP only, number of routers multicast datagrams can pass (1 by default, local network only)
+    MULTICAST_LOOPBACK//UDP only, 1 (default) delivers sent multicast datagrams also to subscribers on the same host
+};
+
+namespace API_RESERVED { class Socket; struct SharedStats; struct AtomicHistogram; }
+class Poller;
+class IOUring;
+class Reactor;
+class SharedMemorySocket;
+class ReliableUDPSocket;
+
+namespace API_RESERVED {
+//Values are sent in little endian order, so on most hosts conversion is removed at compile time
+template<typename T>
+inline T toLittleEndian(const T value){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    for(size_t i = 0; i < sizeof(T) / 2; i++)
+        std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+
+    T swappedValue;
+    std::memcpy(&swappedValue, bytes, sizeof(T));
+    return swappedValue;
+#else
+    return value;
+#endif
+}
+
+//Wire size and copying of one fixed size type
+template<typename T, typename Enable = void> 
+struct Wire;
+
+template<typename... Fields> 
+struct WireSize;
+
+template<> 
+struct WireSize<> : std::integral_constant<size_t, 0> {};
+
+template<typename Field, typename... Fields> 
+struct WireSize<Field, Fields...> : std::integral_constant<size_t, Wire<Field>::value + WireSize<Fields...>::value> {};
+
+inline void storeFields(char*&) {}
+
+template<typename Field, typename... Fields>
+inline void storeFields(char*& writePtr, const Field& field, const Fields&... fields){
+    Wire<Field>::store(writePtr, field);
+    storeFields(writePtr, fields...);
+}
+
+inline void loadFields(const char*&) {}
+
+template<typename Field, typename... Fields>
+inline void loadFields(const char*& readPtr, Field& field, Fields&... fields){
+    Wire<Field>::load(readPtr, field);
+    loadFields(readPtr, fields...);
+}
+
+struct SizeVisitor{
+    template<typename... Fields>
+    std::integral_constant<size_t, WireSize<Fields...>::value> operator()(const Fields&...){
+        return std::integral_constant<size_t, WireSize<Fields...>::value>();
+    }
+};
+
+struct StoreVisitor{
+    char*& writePtr;
+
+    template<typename... Fields>
+    void operator()(const Fields&... fields){
+        storeFields(writePtr, fields...);
+    }
+};
+
+struct LoadVisitor{
+    const char*& readPtr;
+
+    template<typename... Fields>
+    void operator()(Fields&... fields){
+        loadFields(readPtr, fields...);
+    }
+};
 
+template<typename T, typename Enable = void>
+struct IsDataPacketStruct : std::false_type {};
+
+template<typename T>
+struct IsDataPacketStruct<T, typename std::conditional<true, void, typename T::DataPacketFieldsTag>::type> : std::true_type {};
+
+template<typename T>
+struct Wire<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> : std::integral_constant<size_t, sizeof(T)> {
+    static void store(char*& writePtr, const T& value){
+        const T wireValue = toLittleEndian(value);
+        std::memcpy(writePtr, &wireValue, sizeof(T));
+        writePtr += sizeof(T);
+    }
+
+    static void load(const char*& readPtr, T& value){
+        std::memcpy(&value, readPtr, sizeof(T));
+        value = toLittleEndian(value);
+        readPtr += sizeof(T);
+    }
+};
+
+template<typename T>
+struct Wire<T, typename std::enable_if<IsDataPacketStruct<T>::value>::type> 
+    : std::integral_constant<size_t, decltype(std::declval<const T&>().visitDataPacketFields(SizeVisitor()))::value> {
+    static void store(char*& writePtr, const T& value){
+        value.visitDataPacketFields(StoreVisitor{writePtr});
+    }
+
+    static void load(const char*& readPtr, T& value){
+        value.visitDataPacketFields(LoadVisitor{readPtr});
+    }
+};
+}
+
+//Bytes stored inside DataPacket, valid until packet is modified or destroyed.
+class BytesView {
+    public:
+        BytesView() : dataPtr(nullptr), dataSize(0) {}
+
+        BytesView(const char* data, const size_t size) : dataPtr(data), dataSize(size) {}
+
+        const char* data() const { return dataPtr; }
+
+        size_t size() const { return dataSize; }
+
+        const char* begin() const { return dataPtr; }
+
+        const char* end() const { return dataPtr + dataSize; }
+
+        std::string toString() const { return std::string(dataPtr, dataSize); }
+
+#if __cplusplus >= 201703L
+        operator std::string_view() const { return std::string_view(dataPtr, dataSize); }
+#endif
+#if __cplusplus >= 202002L
+        operator std::span<const std::byte>() const { return std::span<const std::byte>((const std::byte*) dataPtr, dataSize); }
+#endif
+
+    private:
+        const char* dataPtr;
+        size_t dataSize;
+};
+
+//Totals of DataPacket compression in process.
+//Ratio is 'uncompressedBytes / compressedBytes', throughput 'uncompressedBytes / compressNanoseconds'.
+struct CompressionStats {
+    std::uint64_t compressedPackets;//Packets made smaller
+    std::uint64_t skippedPackets;//Packets below threshold or incompressible
+    std::uint64_t decompressedPackets;
+    std::uint64_t uncompressedBytes;//Original size of compressed packets
+    std::uint64_t compressedBytes;//Size of the same packets after compression
+    std::uint64_t compressNanoseconds;//Skipped packets are included
+    std::uint64_t decompressNanoseconds;
+};
+
+//Sent with varint header of size and compression flag (1 byte up to 63 bytes of data, 2 bytes up to 8 KiB).
+//TCP packets can have up to 4 GiB (receivers accept 64 MiB unless 'setMaxReceivedSize' raises it),
+//UDP ones have to fit in one datagram.
 class DataPacket {
     public:
         DataPacket();
 
+        DataPacket(const DataPacket& other);
+
+        DataPacket(DataPacket&& other) noexcept;
+
         ~DataPacket();
 
+        DataPacket& operator=(const DataPacket& other);
+
+        DataPacket& operator=(DataPacket&& other) noexcept;
+
         Status allDataReaded();
 
-        //ADD compress
+        //Allocates space for at least 'capacity' bytes of data,
+        //so writing up to that size will not reallocate.
+        void reserve(const size_t capacity);
+
+        //Number of bytes written to packet (readed bytes are included).
+        size_t size() const;
+
+        //Pointer to first byte of packet data.
+        const char* data() const;
+
+        //Number of bytes allocated for packet data.
+        size_t capacity() const;
+
+        //Removes all data, allocated memory is kept for reuse.
+        void clear();
+
+        //Number of bytes taken by 'Fields' in packet, known at compile time.
+        template<typename... Fields>
+        static constexpr size_t wireSize(){
+            return API_RESERVED::WireSize<Fields...>::value;
+        }
+
+        //Writes fixed size values (numbers and SJ_DATAPACKET_FIELDS structs) at once.
+        template<typename... Fields>
+        DataPacket& write(const Fields&... fields){
+            char* writePtr = grow(wireSize<Fields...>());
+            API_RESERVED::storeFields(writePtr, fields...);
+            return *this;
+        }
+
+        //Reads fixed size values at once, 
+        //returns false (with none of them read) when packet is too short.
+        template<typename... Fields>
+        bool read(Fields&... fields){
+            if(bufferSize - readPosition < wireSize<Fields...>())
+                return false;
+
+            const char* readPtr = buffer.get() + readPosition;
+            API_RESERVED::loadFields(readPtr, fields...);
+            readPosition += wireSize<Fields...>();
+            return true;
+        }
+
+        //Writes 'size' bytes prefixed with their varint length (strings use the same format).
+        DataPacket& writeBytes(const void* data, const size_t size);
+
+        //Reads length prefixed bytes without copying, 'value' points into packet.
+        //Returns false (with nothing read) when packet is too short.
+        bool readBytes(BytesView& value);
+
+        //Replaces packet data with its compressed form (fast LZ77 codec), receiver
+        //decompresses it automatically. Packets smaller than 'threshold' or not getting 
+        //smaller are left as they are. Nothing should be written to or readed from compressed packet.
+        //Returns true when packet is compressed.
+        bool compress(const size_t threshold = 256);
+
+        //Restores data of compressed packet, returns false when compressed data is corrupted.
+        bool decompress();
+
+        bool isCompressed() const;
+
+        static CompressionStats getCompressionStats();
+
+        //Received (and decompressed) DataPackets bigger than 'maxSize' are rejected
+        //before memory is allocated for them: TCP receive returns ERROR, as rest
+        //of stream cannot be trusted, UDP datagram is dropped. Applies to whole process,
+        //64 MiB by default, at most 4 GiB - 1. Sending is not limited.
+        static void setMaxReceivedSize(const size_t maxSize);
+        static size_t getMaxReceivedSize();
+
         //ADD encrypt
 
         DataPacket& operator<<(const std::int8_t value);
@@ -62,6 +338,23 @@ class DataPacket {
         DataPacket& operator<<(const std::uint32_t value);
         DataPacket& operator<<(const std::uint64_t value);
         DataPacket& operator<<(const std::string& value);
+        DataPacket& operator<<(const char* value);
+        //Defined here, so they are available when library itself is built with older standard
+#if __cplusplus >= 201703L
+        DataPacket& operator<<(const std::string_view value){
+            return writeBytes(value.data(), value.size());
+        }
+#endif
+#if __cplusplus >= 202002L
+        DataPacket& operator<<(const std::span<const std::byte> value){
+            return writeBytes(value.data(), value.size());
+        }
+#endif
+
+        template<typename T, typename = typename std::enable_if<API_RESERVED::IsDataPacketStruct<T>::value>::type>
+        DataPacket& operator<<(const T& value){
+            return write(value);
+        }
 
         DataPacket& operator>>(std::int8_t& value);
         DataPacket& operator>>(std::int16_t& value);
@@ -72,39 +365,203 @@ class DataPacket {
         DataPacket& operator>>(std::uint32_t& value);
         DataPacket& operator>>(std::uint64_t& value);
         DataPacket& operator>>(std::string& value);
+        DataPacket& operator>>(BytesView& value);
+#if __cplusplus >= 201703L
+        DataPacket& operator>>(std::string_view& value){
+            BytesView bytes;
+            if(readBytes(bytes))
+                value = bytes;
 
-    private:
-        friend class API_RESERVED::Socket;//accesing 'data' in 'send'
-
-        std::queue<char> data;
-
-        template<typename T> 
-        DataPacket& operator<<(const T& value){
-            const char* firstBytePtr = (char*) &value;
-            for(size_t currentByte = 0; currentByte < sizeof(value); currentByte++){
-                const char byteValue = *(firstBytePtr + currentByte);
-                data.push(byteValue);
-            }
+            return (*this);
+        }
+#endif
+#if __cplusplus >= 202002L
+        DataPacket& operator>>(std::span<const std::byte>& value){
+            BytesView bytes;
+            if(readBytes(bytes))
+                value = bytes;
 
-            return *this;
+            return (*this);
         }
+#endif
 
-        template<typename T> 
+        template<typename T, typename = typename std::enable_if<API_RESERVED::IsDataPacketStruct<T>::value>::type>
         DataPacket& operator>>(T& value){
-            if(data.size() != 0){
-                char* firstBytePtr = (char*) &value;
-                for(size_t currentByte = 0; currentByte < sizeof(value); currentByte++){
-                    const char byteValue = data.front();
-                    data.pop();
-                    *(firstBytePtr + currentByte) = byteValue;
-                }
-            }
-            
+            read(value);
             return *this;
         }
+
+    private:
+        friend class API_RESERVED::Socket;//accesing 'buffer' in 'send' and 'receive'
+        friend class SharedMemorySocket;//accesing 'grow' and 'compressed' in 'send' and 'receiveInto'
+        friend class ReliableUDPSocket;//accesing 'grow' and 'compressed' in 'processDatagram'
+
+        std::unique_ptr<char[]> buffer;
+        size_t bufferSize;//Bytes written
+        size_t bufferCapacity;//Bytes allocated
+        size_t readPosition;//Read cursor
+        bool compressed;
+
+        //Appends 'bytes' uninitialized bytes to packet and
+        //returns pointer to the first of them.
+        char* grow(const size_t bytes){
+            if(bufferSize + bytes > bufferCapacity)
+                reallocate(bufferSize + bytes);
+
+            char* const appendedBytesPtr = buffer.get() + bufferSize;
+            bufferSize += bytes;
+            return appendedBytesPtr;
+        }
+
+        void reallocate(const size_t minimumCapacity);
+};
+
+//IPv4 address and port, or path of Unix domain socket, parsed once and reused for every send.
+class Endpoint {
+    public:
+        Endpoint();
+
+        Endpoint(const std::string& ipAddress, const short port);
+
+        //Unix domain socket, for communication on the same host. Sockets connect or send to it
+        //like to IP address, only 'bind'/'beginListening' creates file of socket at 'path'.
+        //Path starting with '@' is in abstract namespace (no file is created).
+        static Endpoint unixSocket(const std::string& path);
+
+        //False when IP address could not be parsed, or path is too long.
+        bool isValid() const;
+
+        bool isUnix() const;
+
+        std::string getIPAddress() const;
+
+        short getPort() const;
+
+        const std::string& getPath() const;
+
+    private:
+        friend class API_RESERVED::Socket;//accesing 'address' and 'port' in 'send' and 'receive'
+        friend class IOUring;//accesing 'toSockaddr' and 'fromSockaddr' in 'sendTo' and 'wait'
+
+        std::uint32_t address;//Network byte order
+        std::uint16_t port;//Network byte order
+        bool valid;
+        std::string path;//Not empty for Unix domain socket
+
+        //Returns size of written address
+        size_t toSockaddr(sockaddr_storage& addr) const;
+        void fromSockaddr(const sockaddr_storage& addr, const size_t addrSize);
+};
+
+//Keeps released DataPackets with their memory, so acquiring 
+//new ones does not allocate in steady state.
+//Not thread safe, every thread should use its own pool ('local').
+class DataPacketPool {
+    public:
+        //Acquired DataPackets have at least 'packetCapacity' bytes reserved.
+        //Up to 'maxPackets' are kept, DataPackets bigger than 'maxPacketCapacity' are freed.
+        DataPacketPool(const size_t packetCapacity = 256, const size_t maxPackets = 4096, const size_t maxPacketCapacity = 65536);
+
+        //Pool of calling thread, used by receiving functions for new DataPackets.
+        static DataPacketPool& local();
+
+        DataPacket acquire();
+
+        //DataPacket is cleared and kept for next 'acquire'.
+        void release(DataPacket&& dataPacket);
+
+        //Releases all 'dataPackets' and clears vector.
+        void release(std::vector<DataPacket>& dataPackets);
+
+        //Number of DataPackets acquired without and with allocation.
+        size_t getHits();
+        size_t getMisses();
+
+        //Number of DataPackets waiting in pool.
+        size_t getSize();
+
+    private:
+        std::vector<DataPacket> dataPackets;
+        size_t packetCapacity;
+        size_t maxPackets;
+        size_t maxPacketCapacity;
+        size_t hits;
+        size_t misses;
 };
 
+//Log-linear histogram (HDR style): values are grouped by powers of 2 and every group
+//is split into 8 buckets, so reported values are within 12.5% of recorded ones.
+class Histogram {
+    public:
+        Histogram();
+
+        void record(const std::uint64_t value);
+
+        void add(const Histogram& other);
+
+        void reset();
+
+        std::uint64_t getCount() const;
+
+        std::uint64_t getMax() const;
+
+        //Upper bound of bucket holding 'percentile' (0 - 100) of recorded values.
+        std::uint64_t getPercentile(const double percentile) const;
+
+    private:
+        friend struct API_RESERVED::AtomicHistogram;//accesing 'buckets' in 'record' and 'snapshot'
+
+        static const size_t BUCKETS_COUNT = 496;
+
+        std::uint64_t buckets[BUCKETS_COUNT];
+        std::uint64_t count;
+        std::uint64_t max;
+
+        static size_t bucketOf(const std::uint64_t value);
+        static std::uint64_t bucketUpperBound(const size_t bucket);
+};
+
+//Counters of socket operations, always on.
+struct SocketCounters {
+    std::uint64_t bytesSent;
+    std::uint64_t bytesReceived;
+    std::uint64_t packetsSent;
+    std::uint64_t packetsReceived;
+    std::uint64_t syscalls;
+    std::uint64_t unavailable;//Operations ended with Status::UNAVAILABLE (EAGAIN)
+    std::uint64_t partialSends;//Sends accepted by kernel only partially
+    std::uint64_t receiveBufferHighWater;//Most bytes of incomplete packets held at once
+};
+
+struct SocketStats {
+    SocketCounters counters;
+
+    //Filled only while histograms are enabled ('enableHistograms')
+    Histogram sentPacketSizes;
+    Histogram receivedPacketSizes;
+    Histogram sendNanoseconds;//From send call (or io_uring submission) until kernel took all bytes
+};
+
+//Histograms cost a clock read per send and atomic updates of aggregates, so they are off by default.
+void enableHistograms(const bool enabled);
+
+//Stats of all sockets in process. Counters of sockets which are still open 
+//are added in batches (every 64 syscalls and when socket is closed).
+SocketStats getProcessStats();
+
 namespace API_RESERVED {
+//SocketCounters of one socket, updated with relaxed atomics
+struct AtomicCounters {
+    std::atomic<std::uint64_t> bytesSent{0};
+    std::atomic<std::uint64_t> bytesReceived{0};
+    std::atomic<std::uint64_t> packetsSent{0};
+    std::atomic<std::uint64_t> packetsReceived{0};
+    std::atomic<std::uint64_t> syscalls{0};
+    std::atomic<std::uint64_t> unavailable{0};
+    std::atomic<std::uint64_t> partialSends{0};
+    std::atomic<std::uint64_t> receiveBufferHighWater{0};
+};
+
 class Socket {
     public:
         enum Type{
@@ -114,21 +571,136 @@ class Socket {
 
         Socket(const Mode mode);
         ~Socket();
-        int create(const Type type);
-        int bind(const short port);
+        int create(const Type type, const bool unixDomain = false);
+        //Removes file left by previous Unix domain socket at the same path
+        int bind(const Endpoint& local);
+        int connect(const Endpoint& receiver);
+        int setOption(const int level, const int option, const int value);
+        Status setOption(const Option option, const int value);
+        Status getOption(const Option option, int* value);
+        //Options and stats aggregation of listening socket are passed to accepted one
+        Status inheritFrom(const Socket& listenSocket);
         Status receiveInto(DataPacket& dataPacket);
+        Status receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets);
         Status receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes);
-        Status sendTo(DataPacket& dataPacket, const std::string* ipAddress = nullptr, const short port = -1);
-        Status sendTo(const void* data, const size_t dataSize, const std::string* ipAddress = nullptr, const short port = -1);
+        Status sendTo(DataPacket& dataPacket, const Endpoint* receiver = nullptr);
+        Status sendTo(DataPacket* dataPackets, const size_t dataPacketsCount);
+        Status sendTo(const void* data, const size_t dataSize, const Endpoint* receiver = nullptr);
+        Status sendBatch(DataPacket* dataPackets, const size_t dataPacketsCount, const Endpoint* receivers, const size_t receiversCount, size_t* sentPackets);
+        //UDP_SEGMENT send of 'data' split into datagrams of 'segmentSize' bytes (last one can be shorter)
+        Status sendSegments(const void* data, const size_t dataSize, const size_t segmentSize, const Endpoint* receiver);
+        //'segmentSize' is set to size of joined datagrams (all but last one have it)
+        Status receiveSegmentsInto(void* buffer, const size_t bufferSize, size_t* readedBytes, size_t* segmentSize);
+        Status receiveBatch(std::vector<DataPacket>& dataPackets, const size_t maxPackets, size_t* receivedPackets, std::vector<Endpoint>* senders);
+        //'offset' -1 reads from current position of 'fd' (the only choice for pipes).
+        //With 'asDataPacket' range is framed and sent whole like DataPacket, otherwise it's like low level send
+        //and 'sentBytes' can be less than 'length' (also when file ends earlier).
+        Status sendFile(const int fd, const std::int64_t offset, const size_t length, const bool asDataPacket, size_t* sentBytes);
+        //'sendId' is set to number of last MSG_ZEROCOPY send, which has to complete before data is reused.
+        //Header of DataPacket is copied, only its data is sent without copying.
+        Status sendZeroCopy(DataPacket& dataPacket, std::uint32_t* sendId);
+        Status sendZeroCopy(const void* data, const size_t dataSize, std::uint32_t* sendId);
+        bool isSendCompleted(const std::uint32_t sendId);
+        Status waitForSendCompletion(const std::uint32_t sendId, const int timeoutMs);
+        //Passes data received outside of socket (io_uring) through packet reassembly
+        //and appends completed DataPackets, 'receivedPackets' is set to their number.
+        Status appendReceived(const char* data, size_t dataSize, std::vector<DataPacket>& dataPackets, size_t* receivedPackets);
+        //Sends rest of partially sent DataPackets, OK when nothing waits anymore
+        Status flushUnsent();
+        size_t getUnsentBytes();
         int getFD();
         void asignFD(const int fd);
         Mode getMode();
         int close();
+        SocketStats getStats();
+        //Listening socket gathers stats of all clients accepted by it
+        void gatherAcceptedStats();
+        SocketStats getAcceptedStats();
+        //Used by IOUring for sends done outside of socket
+        void countSent(const size_t bytes, const bool partial);
+        void countSentPacket(const size_t packetSize);
+        void countSendTime(const std::uint64_t nanoseconds);
 
     private:
         int socket_fd;
         Mode mode;
-        std::list<char> dataPacketsBuffer;
+        Type type;
+        bool unixDomain;
+        std::string boundPath;//File of Unix domain socket, removed on close
+        std::uint64_t boundDevice;//Identity of 'boundPath' file, which can be replaced by other socket
+        std::uint64_t boundInode;
+
+        //Options are remembered, so they are applied to every created socket
+        std::vector<std::pair<Option, int>> options;
+        bool segmentationOffload;//Turned off when kernel or network card can't do it
+        bool receiveOffload;
+
+        Status applyOptions();
+        int applyOption(const Option option, const int value);
+
+        //Received bytes of not yet completed DataPackets.
+        //Unread data lays between 'receiveBufferBegin' and 'receiveBufferEnd',
+        //recv() writes directly after 'receiveBufferEnd'.
+        std::unique_ptr<char[]> receiveBuffer;
+        size_t receiveBufferBegin;
+        size_t receiveBufferEnd;
+
+        //TCP packet bigger than 'receiveBuffer', already sized to its length.
+        //Bytes after 'largePacketEnd' are not received yet.
+        DataPacket largePacket;
+        size_t largePacketEnd;
+
+        //One slot per datagram of receiveBatch, allocated at first use.
+        std::unique_ptr<char[]> batchBuffer;
+
+        //Rest of DataPackets partially sent in NON_BLOCKING Mode, it goes before any other data.
+        //Bytes from 'unsentOffset' wait, vector is cleared when all of them are sent.
+        //Rest of 'sendFile' follows them, read from duplicate of its descriptor.
+        std::vector<char> unsentBytes;
+        size_t unsentOffset;
+        int unsentFile;
+        std::int64_t unsentFileOffset;//-1 reads from current position
+        size_t unsentFileBytes;
+        bool unsentFromPipe;
+
+        //Counters are added to aggregates ('acceptedStats' of listener and process) in batches,
+        //'flushedCounters' is the part already added. Histograms are allocated when enabled (owned here).
+        //Both are atomic, so sending and receiving threads can update them while 'getStats' reads them.
+        AtomicCounters counters;
+        AtomicCounters flushedCounters;
+        std::shared_ptr<SharedStats> listenerStats;
+        std::shared_ptr<SharedStats> acceptedStats;
+        std::atomic<AtomicHistogram*> sentPacketSizes;
+        std::atomic<AtomicHistogram*> receivedPacketSizes;
+        std::atomic<AtomicHistogram*> sendNanoseconds;
+
+        //Kernel numbers MSG_ZEROCOPY sends from 0 and reports ranges of completed ones.
+        //Every send before 'zeroCopyCompleted' is completed, ranges after a gap wait in 'zeroCopyCompletedRanges'.
+        std::uint32_t zeroCopySends;
+        std::uint32_t zeroCopyCompleted;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> zeroCopyCompletedRanges;
+        bool zeroCopyDeferred;//Kernel copied data anyway (e.g. loopback), so next sends are copied at once
+
+        void countSyscall();
+        void countUnavailable();
+        void countReceived(const size_t bytes);
+        void countReceivedPacket(const size_t packetSize);
+        void countBuffered();
+        void flushStats();
+
+        Status extractDataPacket(DataPacket& dataPacket);
+        Status extractDataPackets(std::vector<DataPacket>& dataPackets, size_t* extractedPackets);
+        size_t prepareReceiveBuffer();
+        Status fillReceiveBuffer();
+        //'continuation' means part of the same DataPackets was already sent, so UNAVAILABLE can't be returned.
+        //Rest which kernel does not take at once is copied to 'unsentBytes' then.
+        Status sendMessage(msghdr& message, int flags = 0, const bool continuation = false);
+        void appendUnsent(const msghdr& message);
+        void clearUnsent();
+        //'afterHeader' means part of DataPacket was already sent, so data which can't be sent is copied to 'unsentBytes'
+        Status sendZeroCopyData(const void* data, const size_t dataSize, const bool afterHeader, std::uint32_t* sendId);
+        //Returns number of completion notifications read
+        size_t readSendCompletions();
 };
 }
 
@@ -140,17 +712,81 @@ class TCPClientSocket {
 
         Status connect(const std::string& ipAddress, const short port);
 
+        //'server' can be Unix domain socket (Endpoint::unixSocket), then TCP options are not used.
+        //In NON_BLOCKING Mode connection is only started and UNAVAILABLE is returned 
+        //until it's established. 'connect' has to be repeated to finish it, best when 
+        //socket becomes writable (Poller with Interest::WRITE, Reactor::connect).
+        Status connect(const Endpoint& server);
+
+        //Connection which is not established in 'timeoutMs' milliseconds is closed and ERROR is returned.
+        //In NON_BLOCKING Mode time is counted from first call.
+        Status connect(const Endpoint& server, const int timeoutMs);
+
+        //Connects every socket to server with the same index, or all of them to the only server,
+        //with all handshakes done at once, in any Mode. Waits up to 'timeoutMs' milliseconds 
+        //(-1 means forever) and closes not established connections. 
+        //'connectedSockets' is set to number of connected sockets, OK means all of them.
+        static Status connect(const std::vector<TCPClientSocket*>& clientSockets, const std::vector<Endpoint>& servers, const int timeoutMs, size_t* connectedSockets);
+
         Status disconnect();
 
+        //In NON_BLOCKING Mode DataPacket accepted by kernel only partially is not lost, its rest
+        //waits in socket and is sent before next data (by next send or 'flush').
+        //While it can't be sent, all sends return UNAVAILABLE.
         Status send(DataPacket& dataPacket);
 
+        //Sends all DataPackets with as few syscalls as possible.
+        //On UNAVAILABLE none of DataPackets was sent, otherwise all of them
+        //were accepted (part which kernel can't take at once is copied to socket).
+        Status send(std::vector<DataPacket>& dataPackets);
+
         //If DataPacket is used, it's not recommended to use
         //low level send(const* void data, ...) because DataPackets 
         //lost may occur.
         Status send(const void* data, const size_t dataSize);
 
+        //Sends 'length' bytes of file 'fd' from 'offset' as one DataPacket, 
+        //without copying them through user space (sendfile, or splice for pipes).
+        //'offset' -1 reads from current position of 'fd', what is required for pipes.
+        //Range outside of regular file is ERROR, before anything is sent. In NON_BLOCKING Mode pipe has to hold
+        //all 'length' bytes already (UNAVAILABLE until it does, ERROR when they can't fit into it).
+        //Rest which kernel does not take at once waits in socket like in 'send' (from duplicate of 'fd').
+        //When file ends earlier, DataPacket can't be completed, so socket is closed and ERROR is returned.
+        Status sendFile(const int fd, const std::int64_t offset, const size_t length);
+
+        //Low level version of 'sendFile' (like send(const void* data, ...)), sends raw bytes.
+        //In NON_BLOCKING Mode and when file ends earlier 'sentBytes' can be less than 'length'.
+        Status sendFile(const int fd, const std::int64_t offset, const size_t length, size_t* sentBytes);
+
+        //Sends DataPacket like 'send', but when Option::ZERO_COPY is set and packet is big,
+        //network card reads it straight from DataPacket (MSG_ZEROCOPY). DataPacket must not be changed
+        //or destroyed until isSendCompleted('sendId'). Small packets are copied as usual.
+        Status sendZeroCopy(DataPacket& dataPacket, std::uint32_t* sendId);
+
+        //Low level version of 'sendZeroCopy', 'data' must stay untouched until isSendCompleted('sendId').
+        Status sendZeroCopy(const void* data, const size_t dataSize, std::uint32_t* sendId);
+
+        //Sends rest of partially sent DataPackets (NON_BLOCKING Mode), best when socket becomes writable.
+        //OK when nothing waits anymore, UNAVAILABLE while socket buffer is still full.
+        Status flush();
+
+        //Number of bytes waiting in socket for 'flush'.
+        size_t getUnsentBytes();
+
+        //Reads completion notifications of zero copy sends, true when data of 'sendId' can be reused.
+        bool isSendCompleted(const std::uint32_t sendId);
+
+        //Waits up to 'timeoutMs' milliseconds (-1 means forever) for completion of 'sendId', UNAVAILABLE on timeout.
+        Status waitForSendCompletion(const std::uint32_t sendId, const int timeoutMs = -1);
+
         Status receiveInto(DataPacket& dataPacket);
 
+        //Appends every complete DataPacket available to 'dataPackets',
+        //using one recv (BLOCKING mode repeats it until first packet is complete).
+        //'receivedPackets' is set to number of appended DataPackets.
+        //DataPackets are taken from DataPacketPool::local(), so they can be released there.
+        Status receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets);
+
         //If DataPacket is used, it's not recommended to use
         //low level receiveInto(const* void buffer, ...) because DataPackets 
         //lost may occur.
@@ -158,10 +794,29 @@ class TCPClientSocket {
 
         bool isConnected();
 
+        //Connection is started, but not established yet
+        bool isConnecting();
+
+        //Option can be set before 'connect', it's applied then.
+        Status setOption(const Option option, const int value);
+
+        Status getOption(const Option option, int* value);
+
+        //Can be called from any thread, also while other threads send and receive.
+        SocketStats getStats();
+
     private:
         friend class TCPListenSocket;//accesing 'socket' in 'acceptNewClient'
+        friend class Poller;//accesing 'socket' in 'add'
+        friend class IOUring;//accesing 'socket' in 'add'
+        friend class Reactor;//accesing 'socket' in 'wait'
 
         API_RESERVED::Socket socket;
+        bool connecting;
+        std::uint64_t connectDeadline;//Monotonic nanoseconds, 0 when there is no timeout
+
+        Status beginConnect(const Endpoint& server, const int timeoutMs);
+        Status finishConnect(const int waitMs);
 };
 
 class TCPListenSocket {
@@ -171,6 +826,14 @@ class TCPListenSocket {
         ~TCPListenSocket();
 
         Status beginListening(const short port);
+
+        //'backlog' is the maximum number of connections waiting for accept.
+        //With 'reusePort' many sockets can listen on the same port
+        //and kernel spreads incoming connections between them.
+        Status beginListening(const short port, const int backlog, const bool reusePort);
+
+        //Listens on given IP address, or Unix domain socket (accepted clients use it too).
+        Status beginListening(const Endpoint& local, const int backlog = 128, const bool reusePort = false);
         
         Status endListening();
 
@@ -178,10 +841,54 @@ class TCPListenSocket {
 
         bool isListening();
 
+        //Option can be set before 'beginListening', it's applied then.
+        //Accepted clients get the same options.
+        Status setOption(const Option option, const int value);
+
+        Status getOption(const Option option, int* value);
+
+        //Stats of all clients accepted by this socket (also closed ones).
+        SocketStats getStats();
+
     private:
+        friend class Poller;//accesing 'socket' in 'add'
+        friend class IOUring;//accesing 'socket' in 'add'
+        friend class Reactor;//accesing 'socket' in 'wait'
+        friend class TCPShardedListenSocket;//accesing 'socket' in 'pinShard'
+
         API_RESERVED::Socket socket;
 };
 
+//Many listening sockets on the same port (SO_REUSEPORT), 
+//intended for one accepting thread per shard.
+class TCPShardedListenSocket {
+    public:
+        TCPShardedListenSocket(const Mode mode, const size_t shardsCount);
+
+        ~TCPShardedListenSocket();
+
+        //On ERROR none of shards is listening.
+        Status beginListening(const short port, const int backlog = 128);
+
+        Status endListening();
+
+        size_t getShardsCount();
+
+        TCPListenSocket& getShard(const size_t shard);
+
+        //Prefers connections handled by 'cpu' for 'shard' and pins calling thread to 'cpu'.
+        //Should be called from the thread accepting on 'shard'.
+        Status pinShard(const size_t shard, const int cpu);
+
+        bool isListening();
+
+        //Stats of clients accepted by all shards.
+        SocketStats getStats();
+
+    private:
+        std::vector<std::unique_ptr<TCPListenSocket>> shards;
+};
+
 class UDPSocket {
     public:
         UDPSocket(const Mode mode);
@@ -189,26 +896,804 @@ class UDPSocket {
         ~UDPSocket();
 
         Status bind(const short port);
+
+        //Binds to given IP address, or Unix domain datagram socket
+        //(then it sends only to other Unix domain sockets).
+        Status bind(const Endpoint& local);
         
         Status unbind();
 
+        //Sets default receiver, so 'send' can be used and kernel skips
+        //address handling on every datagram. Only datagrams from
+        //'receiver' are received afterwards.
+        Status connect(const Endpoint& receiver);
+
+        //Removes default receiver set by 'connect'.
+        Status disconnect();
+
+        //Sends to receiver set by 'connect'.
+        Status send(DataPacket& dataPacket);
+        Status send(const void* data, const size_t dataSize);
+
         Status sendTo(DataPacket& dataPacket, const std::string& ipAddress, const short port);
 
+        //Faster than parsing 'ipAddress' on every call.
+        Status sendTo(DataPacket& dataPacket, const Endpoint& receiver);
+
         //If DataPacket is used, it's not recommended to use
         //low level send(const* void data, ...) because DataPackets 
         //lost may occur.
         Status sendTo(const void* data, const size_t dataSize, const std::string& ipAddress, const short port);
+        Status sendTo(const void* data, const size_t dataSize, const Endpoint& receiver);
 
         Status receiveInto(DataPacket& dataPacket);
 
         //If DataPacket is used, it's not recommended to use
         //low level receiveInto(const* void buffer, ...) because DataPackets 
-        //lost may occur.
+        //lost may occur. With Option::RECEIVE_OFFLOAD 'receiveSegmentsInto' should be used instead.
         Status receiveInto(void* buffer, const size_t bufferSize, size_t* readedBytes);
 
+        //Sends every DataPacket to receiver with the same index, 
+        //or all of them to the only receiver, with as few syscalls as possible.
+        //On UNAVAILABLE only first 'sentPackets' DataPackets were sent.
+        Status sendBatch(std::vector<DataPacket>& dataPackets, const std::vector<Endpoint>& receivers, size_t* sentPackets);
+        Status sendBatch(std::vector<DataPacket>& dataPackets, const Endpoint& receiver, size_t* sentPackets);
+
+        //Low level sends of 'data' split by kernel or network card into datagrams of 'segmentSize' bytes,
+        //last one can be shorter (UDP_SEGMENT). Up to 64 datagrams and 64 KiB of data are sent at once.
+        Status sendSegments(const void* data, const size_t dataSize, const size_t segmentSize);
+        Status sendSegmentsTo(const void* data, const size_t dataSize, const size_t segmentSize, const Endpoint& receiver);
+
+        //Low level receive for Option::RECEIVE_OFFLOAD, 'buffer' can hold many joined datagrams of one sender.
+        //'segmentSize' is set to size of every of them but the last one, which can be shorter.
+        Status receiveSegmentsInto(void* buffer, const size_t bufferSize, size_t* readedBytes, size_t* segmentSize);
+
+        //Appends up to 'maxPackets' received DataPackets to 'dataPackets' 
+        //(and their senders to 'senders' when given), using one syscall.
+        //DataPackets are taken from DataPacketPool::local().
+        //BLOCKING mode waits only for the first one. With Option::RECEIVE_OFFLOAD
+        //every joined datagram can bring up to 64 DataPackets, so there can be more of them.
+        //'receivedPackets' is set to number of appended DataPackets.
+        Status receiveBatch(std::vector<DataPacket>& dataPackets, const size_t maxPackets, size_t* receivedPackets, std::vector<Endpoint>* senders = nullptr);
+
         bool isBinded();
 
+        //Receives datagrams sent to IPv4 multicast group, socket has to be bound to its port first
+        //(with Option::REUSE_ADDRESS, when more subscribers on the host use it). 'interface' is name ("eth0")
+        //or IP address of network interface, empty lets kernel choose it by routing table.
+        Status joinGroup(const std::string& groupAddress, const std::string& interface = "");
+        Status leaveGroup(const std::string& groupAddress, const std::string& interface = "");
+
+        //Network interface (name or IP address) sending datagrams to multicast groups, empty for default.
+        Status setMulticastInterface(const std::string& interface);
+
+        //Option can be set before 'bind', it's applied then.
+        Status setOption(const Option option, const int value);
+
+        Status getOption(const Option option, int* value);
+
+        //Can be called from any thread, also while other threads send and receive.
+        SocketStats getStats();
+
     private:
+        friend class Poller;//accesing 'socket' in 'add'
+        friend class IOUring;//accesing 'socket' in 'add'
+        friend class Reactor;//accesing 'socket' in 'wait'
+        friend class ReliableUDPSocket;//accesing 'socket' in 'waitForEvents'
+
         API_RESERVED::Socket socket;
+
+        Status setMembership(const std::string& groupAddress, const std::string& interface, const bool join);
+};
+
+//Sends DataPackets to IPv4 multicast group, one syscall reaches all subscribers
+//(UDPSockets which joined it), so cost of sending does not grow with their number.
+class MulticastPublisher {
+    public:
+        MulticastPublisher(const Mode mode);
+
+        ~MulticastPublisher();
+
+        //'interface' is name ("eth0") or IP address of network interface sending datagrams,
+        //empty lets kernel choose it by routing table.
+        Status open(const Endpoint& group, const std::string& interface = "");
+
+        Status close();
+
+        bool isOpen();
+
+        Status publish(DataPacket& dataPacket);
+
+        //Sends all DataPackets with as few syscalls as possible.
+        //On UNAVAILABLE only first 'sentPackets' DataPackets were sent.
+        Status publish(std::vector<DataPacket>& dataPackets, size_t* sentPackets);
+
+        //Option (like MULTICAST_TTL or MULTICAST_LOOPBACK) can be set before 'open', it's applied then.
+        Status setOption(const Option option, const int value);
+
+        Status getOption(const Option option, int* value);
+
+        SocketStats getStats();
+
+    private:
+        UDPSocket udpSocket;
+        Endpoint group;
+};
+
+enum struct Delivery{
+    RELIABLE_ORDERED,//Resent until acknowledged, delivered in order of its stream
+    UNRELIABLE,//Never resent, delivered as it comes
+    LATEST_ONLY//Like UNRELIABLE, but messages older than already delivered one are dropped
+};
+
+//Losses and delays of sent datagrams, for testing ReliableUDPSocket on loopback.
+//Jitter (random delay up to 'jitterMs' added to 'delayMs') reorders datagrams.
+struct LinkSimulation {
+    double lossRatio;//0.0 - 1.0
+    int delayMs;
+    int jitterMs;
+    std::uint64_t seed;//The same seed drops and delays the same datagrams
+};
+
+struct ReliableStats {
+    std::uint64_t messagesSent;
+    std::uint64_t messagesReceived;
+    std::uint64_t retransmittedMessages;
+    std::uint64_t datagramsSent;
+    std::uint64_t datagramsReceived;
+    std::uint64_t lostDatagrams;//Declared lost by sender
+    std::uint64_t duplicateDatagrams;
+    std::uint64_t simulatedLosses;//Dropped by LinkSimulation
+    std::uint64_t smoothedRttNanoseconds;//0 before first RTT sample
+    std::uint64_t rttVariationNanoseconds;
+    std::uint64_t minRttNanoseconds;
+    std::uint64_t congestionWindow;//Bytes
+    std::uint64_t bytesInFlight;
+    std::uint64_t pendingMessages;//Waiting to be sent or acknowledged
+};
+
+//Messages (DataPackets) exchanged with one peer over UDP in up to 256 streams. Reliable messages
+//are acknowledged selectively and resent when lost, and only their own stream waits for them, 
+//so loss does not stall other streams (no head-of-line blocking between them). Sending is limited
+//by congestion window (NewReno) and paced over smoothed RTT. Both sides 'bind', one of them 
+//'connect's and the other takes peer from the first datagram it receives.
+//There is no background thread: timers run inside calls, so NON_BLOCKING side has to call 'update' 
+//at latest after 'getTimeoutMs' (and whenever socket is readable). Messages are not split into
+//datagrams, ones up to about 1 KiB are packed together and bigger ones are sent alone.
+class ReliableUDPSocket {
+    public:
+        ReliableUDPSocket(const Mode mode);
+
+        ~ReliableUDPSocket();
+
+        Status bind(const short port);
+        Status bind(const Endpoint& local);
+
+        Status connect(const Endpoint& peer);
+
+        //Drops all messages and state of connection, so socket can connect or be connected again.
+        Status disconnect();
+
+        bool isConnected();
+
+        //Delivery of messages sent to 'stream' (RELIABLE_ORDERED by default),
+        //ERROR when any message was already sent to it.
+        Status setDelivery(const std::uint8_t stream, const Delivery delivery);
+
+        //Queues copy of DataPacket and sends as much as congestion window allows.
+        //When 4096 messages are waiting to be sent or acknowledged, or reliable stream
+        //has 4096 messages from its oldest unacknowledged one on (receiver buffers only that many),
+        //BLOCKING Mode waits for acknowledgements and NON_BLOCKING returns UNAVAILABLE.
+        Status send(DataPacket& dataPacket, const std::uint8_t stream = 0);
+
+        //'stream' is set to stream of received message when given.
+        Status receiveInto(DataPacket& dataPacket, std::uint8_t* stream = nullptr);
+
+        //Receives datagrams, acknowledges them, resends lost messages and sends queued ones.
+        Status update();
+
+        //Milliseconds until 'update' has work to do (-1 when nothing is waiting).
+        int getTimeoutMs();
+
+        //Waits up to 'timeoutMs' (-1 forever) until all messages are sent and reliable ones are acknowledged,
+        //in both Modes. Returns UNAVAILABLE on timeout.
+        Status flush(const int timeoutMs = -1);
+
+        //Applies to datagrams sent afterwards, zero 'lossRatio', 'delayMs' and 'jitterMs' turn it off.
+        void setLinkSimulation(const LinkSimulation& linkSimulation);
+
+        ReliableStats getStats();
+
+    private:
+        struct Message;
+        struct SentPacket;
+        struct SendStream;
+        struct ReceiveStream;
+
+        Mode mode;
+        UDPSocket udpSocket;//NON_BLOCKING, 'mode' is handled by waiting in 'waitForEvents'
+        bool connected;
+        std::uint32_t session;//Random, peer resets its state when it changes
+        std::uint32_t peerSession;
+        std::uint32_t previousPeerSession;//Late datagrams of restarted peer are ignored
+        ReliableStats stats;
+
+        //Sending
+        Delivery deliveries[256];
+        std::uint32_t sendSequences[256];
+        std::uint64_t nextMessageID;
+        std::uint64_t nextPacketNumber;//Starts from 1, so 0 means none
+        std::deque<std::unique_ptr<Message>> sendQueue;//Not sent yet
+        std::unordered_map<std::uint64_t, std::unique_ptr<Message>> unacknowledged;//Reliable messages sent at least once
+        std::deque<std::uint64_t> retransmissions;//IDs of lost messages, sent before 'sendQueue'
+        std::map<std::uint64_t, std::unique_ptr<SentPacket>> sentPackets;//By packet number
+        std::unique_ptr<SendStream> sendStreams[256];//Reliable ones only
+
+        //Loss detection, RTT and congestion control
+        std::uint64_t largestAcknowledged;
+        std::uint64_t latestRtt;
+        std::uint64_t smoothedRtt;
+        std::uint64_t rttVariation;
+        std::uint64_t minRtt;//0 before first sample
+        std::uint64_t lossTime;//Earliest time when sent datagram will be declared lost, 0 when none
+        std::uint64_t lastAckElicitingSent;
+        unsigned probeTimeouts;//Consecutive ones, every doubles next probe timeout
+        unsigned probes;//Datagrams sent regardless of congestion window after probe timeout
+        std::uint64_t congestionWindow;
+        std::uint64_t slowStartThreshold;
+        std::uint64_t bytesInFlight;
+        std::uint64_t recoveryStart;//Datagrams sent before are not reducing window again
+        std::uint64_t nextSendTime;//Pacing
+
+        //Receiving
+        std::deque<std::pair<std::uint64_t, std::uint64_t>> receivedRanges;//Lowest and highest packet number, highest ranges first
+        std::uint64_t largestReceivedTime;
+        unsigned receivedSinceAck;
+        unsigned ackElicitingReceived;//Since last acknowledgement sent
+        std::uint64_t ackDeadline;
+        bool ackImmediately;//Datagram came out of order
+        std::unique_ptr<ReceiveStream> receiveStreams[256];
+        std::deque<std::pair<std::uint8_t, DataPacket>> receivedMessages;
+        std::vector<DataPacket> datagrams;
+        std::vector<Endpoint> senders;
+
+        //Link simulation
+        LinkSimulation linkSimulation;
+        std::uint64_t randomState;
+        std::multimap<std::uint64_t, DataPacket> delayedDatagrams;//By time of sending
+
+        //Forgets everything sent and received, queued messages are numbered again
+        void resetConnection();
+        //Message can't be queued until some are acknowledged
+        bool isSendBlocked(const std::uint8_t stream);
+        Status waitForEvents(const int timeoutMs);
+        void receiveDatagrams(const std::uint64_t now);
+        //Returns false when datagram is not valid
+        bool processDatagram(DataPacket& datagram, const std::uint64_t now);
+        bool processAcknowledgement(DataPacket& datagram, const std::uint64_t now);
+        //Returns false when packet was already received
+        bool recordReceived(const std::uint64_t packetNumber, const bool ackEliciting, const std::uint64_t now);
+        void deliver(const std::uint8_t stream, const Delivery delivery, const std::uint32_t sequence, DataPacket&& message);
+        void updateRtt(const std::uint64_t rttSample, const std::uint64_t ackDelay);
+        void detectLostPackets(const std::uint64_t now);
+        void requeue(const std::uint64_t messageID, const std::uint64_t packetNumber);
+        std::uint64_t getProbeDeadline();
+        std::uint64_t getNextDeadline();
+        void sendDatagrams(const std::uint64_t now);
+        void writeAcknowledgement(DataPacket& datagram, const std::uint64_t now);
+        //Sends datagram now, or drops or delays it with LinkSimulation
+        void transmit(DataPacket& datagram, const std::uint64_t now);
+};
+
+//DataPackets exchanged by two processes (or threads) on the same host through shared memory,
+//without any syscall while receiving side is not sleeping. One side 'create's channel, 
+//the other 'open's it with the same name. Every direction has its own ring of 'capacity' bytes,
+//so DataPacket (with up to 5 bytes of header) must not be bigger.
+//Can't be used with Poller/IOUring/Reactor, BLOCKING Mode sleeps on futex instead.
+class SharedMemorySocket {
+    public:
+        SharedMemorySocket(const Mode mode);
+
+        ~SharedMemorySocket();
+
+        //'name' is name of shared memory object ("/name"), 'capacity' is rounded up to power of 2.
+        Status create(const std::string& name, const size_t capacity = 1 << 20);
+
+        //ERROR when channel does not exist, or other side already opened it.
+        Status open(const std::string& name);
+
+        Status disconnect();
+
+        //Sending side sees ERROR after other side disconnected, 
+        //receiving one after that and taking all DataPackets sent before.
+        bool isConnected();
+
+        //Waiting side spins up to 'microseconds' before it sleeps, 
+        //trading CPU time for latency (0 by default).
+        void setBusyPoll(const int microseconds);
+
+        Status send(DataPacket& dataPacket);
+
+        //Sends all DataPackets, waking other side only once.
+        //On UNAVAILABLE none of DataPackets was sent. In NON_BLOCKING Mode
+        //all of them have to fit into ring at once, bigger batch is ERROR.
+        Status send(std::vector<DataPacket>& dataPackets);
+
+        Status receiveInto(DataPacket& dataPacket);
+
+        //Appends every DataPacket available (BLOCKING Mode waits for the first one),
+        //'receivedPackets' is set to their number. DataPackets are taken from DataPacketPool::local().
+        Status receiveInto(std::vector<DataPacket>& dataPackets, size_t* receivedPackets);
+
+    private:
+        struct Ring;
+        struct Channel;
+
+        Mode mode;
+        std::string name;
+        bool creator;//Creator removes shared memory object
+        Channel* channel;
+        size_t channelSize;
+        size_t capacity;
+        Ring* sendRing;
+        Ring* receiveRing;
+        char* sendData;
+        char* receiveData;
+        int busyPollMicroseconds;
+
+        Status map(const int fd, const size_t size);
+        void unmap();
+        //Waits until 'frameSize' bytes can be written after 'head'
+        Status waitForSpace(const size_t frameSize, const std::uint64_t head, const bool canBeUnavailable);
+        //Waits until any byte can be read at 'tail'
+        Status waitForData(const std::uint64_t tail);
+        //Makes bytes before 'head'/'tail' visible to other side and wakes it when it sleeps
+        void publish(const std::uint64_t head);
+        void consume(const std::uint64_t tail);
+        void write(const void* data, const size_t size, std::uint64_t& head);
+        void read(void* data, const size_t size, std::uint64_t& tail);
+        Status readDataPacket(DataPacket& dataPacket, std::uint64_t& tail);
+};
+
+enum struct Interest{
+    READ = 1,//Receiving or accepting new client is possible
+    WRITE = 2,//Socket buffer has space for sending
+    READ_WRITE = READ | WRITE
+};
+
+enum struct Trigger{
+    //Socket is reported as long as it's ready.
+    LEVEL,
+    //Socket is reported once, when it become ready.
+    //Receive/send/accept have to be repeated until UNAVAILABLE is returned,
+    //otherwise socket will not be reported again.
+    EDGE
+};
+
+struct PollEvent{
+    void* userData;//Value passed when socket was added
+    bool readable;
+    bool writable;
+    bool closed;//Peer hung up or error occured on socket
+};
+
+//Waits for readiness of many sockets at once (epoll).
+//Sockets should be in NON_BLOCKING Mode and must be connected/listening/binded
+//before they are added. Closed sockets are removed automatically.
+//Received DataPackets are buffered inside socket, so after readable event
+//receiveInto should be repeated until UNAVAILABLE is returned.
+//Rest of partially sent DataPackets waits inside socket too, while
+//TCPClientSocket::getUnsentBytes is not 0, writable event should call 'flush'.
+class Poller {
+    public:
+        typedef std::function<void(const PollEvent& event)> Callback;
+
+        Poller();
+
+        ~Poller();
+
+        Status add(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL, void* userData = nullptr);
+        Status add(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL, void* userData = nullptr);
+        Status add(UDPSocket& udpSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL, void* userData = nullptr);
+
+        //Callback is called from dispatch when socket is ready.
+        Status add(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger, Callback callback);
+        Status add(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger, Callback callback);
+        Status add(UDPSocket& udpSocket, const Interest interest, const Trigger trigger, Callback callback);
+
+        Status modify(TCPClientSocket& clientSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL);
+        Status modify(TCPListenSocket& listenSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL);
+        Status modify(UDPSocket& udpSocket, const Interest interest, const Trigger trigger = Trigger::LEVEL);
+
+        Status remove(TCPClientSocket& clientSocket);
+        Status remove(TCPListenSocket& listenSocket);
+        Status remove(UDPSocket& udpSocket);
+
+        //Waits up to 'timeoutMs' milliseconds (-1 means forever) for ready sockets
+        //and appends them to 'readyEvents'.
+        Status wait(std::vector<PollEvent>& readyEvents, const int timeoutMs = -1);
+
+        //Waits like 'wait' and calls callbacks of ready sockets.
+        //Sockets added without callback are skipped.
+        Status dispatch(const int timeoutMs = -1);
+
+        //Makes current or next 'wait' return at once (without event for it).
+        //Can be called from any thread.
+        Status wake();
+
+    private:
+        struct Registration{
+            void* userData;
+            Callback callback;
+        };
+
+        int epoll_fd;
+        int wake_fd;//eventfd, always registered in epoll
+        std::unordered_map<int, Registration> registrations;
+        std::vector<PollEvent> dispatchedEvents;
+        std::vector<int> dispatchedFDs;
+
+        Status add(API_RESERVED::Socket& socket, const Interest interest, const Trigger trigger, void* userData, Callback callback);
+        Status modify(API_RESERVED::Socket& socket, const Interest interest, const Trigger trigger);
+        Status remove(API_RESERVED::Socket& socket);
+        Status wait(std::vector<PollEvent>& readyEvents, std::vector<int>* readyFDs, const int timeoutMs);
 };
+
+struct IOCompletion{
+    enum struct Type{
+        ACCEPT,//New client can be taken with 'acceptNewClient'
+        RECEIVE,//'dataPackets' were received
+        SEND//Queued DataPackets were sent
+    };
+
+    Type type;
+    void* userData;//Value passed when socket was added
+    Status status;//ERROR when connection was closed or operation failed
+    std::vector<DataPacket> dataPackets;
+    std::vector<Endpoint> senders;//Sender of every DataPacket, UDP only
+};
+
+//Completion based I/O (io_uring) with multishot accept and receive into
+//kernel registered buffers. Sends are queued and submitted in batches on 'wait'.
+//Requires Linux 6.0, when 'isAvailable' returns false Poller should be used instead.
+//Added sockets have to be removed before they are destroyed.
+class IOUring {
+    public:
+        IOUring(const unsigned entries = 256);
+
+        ~IOUring();
+
+        bool isAvailable();
+
+        //Accepting/receiving starts with next 'wait'.
+        Status add(TCPClientSocket& clientSocket, void* userData = nullptr);
+        Status add(TCPListenSocket& listenSocket, void* userData = nullptr);
+        Status add(UDPSocket& udpSocket, void* userData = nullptr);
+
+        //Cancels pending operations, not sent DataPackets are dropped.
+        //Cancellation is submitted at once, so socket can be closed after OK. On ERROR socket stays added.
+        Status remove(TCPClientSocket& clientSocket);
+        Status remove(TCPListenSocket& listenSocket);
+        Status remove(UDPSocket& udpSocket);
+
+        //DataPacket is owned by ring until SEND completion, then it's released to
+        //DataPacketPool::local() of thread calling 'wait', which also provides received ones.
+        //DataPackets queued for the same client are sent in order.
+        Status send(TCPClientSocket& clientSocket, DataPacket&& dataPacket);
+        Status sendTo(UDPSocket& udpSocket, DataPacket&& dataPacket, const Endpoint& receiver);
+
+        //Takes client accepted by 'listenSocket', UNAVAILABLE when none is waiting.
+        Status acceptNewClient(TCPListenSocket& listenSocket, TCPClientSocket& newClient);
+
+        //Submits queued operations and waits up to 'timeoutMs' milliseconds 
+        //(-1 means forever) for completions, which are appended to 'completions'.
+        Status wait(std::vector<IOCompletion>& completions, const int timeoutMs = -1);
+
+    private:
+        enum Kind{
+            CLIENT,
+            LISTENER,
+            UDP
+        };
+
+        struct Ring;
+        struct Operation;
+        struct Registration;
+
+        std::unique_ptr<Ring> ring;
+        std::unordered_map<std::uint64_t, std::unique_ptr<Operation>> operations;
+        std::unordered_map<int, std::unique_ptr<Registration>> registrations;
+        std::uint64_t nextID;
+
+        Status add(API_RESERVED::Socket& socket, const Kind kind, void* userData);
+        Status remove(API_RESERVED::Socket& socket);
+        Operation* createOperation(const IOCompletion::Type type, const Registration& registration);
+        bool submitAccept(Operation& operation, const Registration& registration);
+        bool submitReceive(Operation& operation, const Registration& registration);
+        bool submitSend(Operation& operation);
+        bool sendQueued(Registration& registration);
+        void complete(const std::uint64_t operationID, const std::int32_t result, const std::uint32_t flags, std::vector<IOCompletion>& completions);
+};
+
+#if __cplusplus >= 202002L
+//Coroutine which starts immediately and frees itself when finished,
+//nobody waits for its end. Example: sj::Task serve(sj::Reactor& reactor, ...){ co_await ...; }
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+#endif
+
+//Resumes coroutines (or any other waiters) when sockets they wait for become ready,
+//all on thread calling 'run'. Sockets should be in NON_BLOCKING Mode.
+//Every socket can have one reading and one writing waiter at the same time
+//and it must not be closed while it's waited for.
+//Suspended coroutines are not resumed after Reactor is destroyed,
+//so it has to outlive them (and their sockets).
+class Reactor {
+    public:
+        //Called once, when waited socket became ready or closed
+        typedef void (*Resume)(void* waiter);
+
+        Reactor();
+
+        ~Reactor();
+
+        Status wait(TCPClientSocket& clientSocket, const Interest interest, Resume resume, void* waiter);
+        Status wait(TCPListenSocket& listenSocket, const Interest interest, Resume resume, void* waiter);
+        Status wait(UDPSocket& udpSocket, const Interest interest, Resume resume, void* waiter);
+
+        //Waits up to 'timeoutMs' milliseconds (-1 means forever) for ready sockets and resumes their waiters.
+        Status runOnce(const int timeoutMs = -1);
+
+        //Resumes waiters until none is left.
+        Status run();
+
+        size_t getWaitingCount();
+
+#if __cplusplus >= 202002L
+        //Awaitable versions of socket operations, 'co_await' gives their Status.
+        //Operation is tried at once and repeated after socket becomes ready,
+        //so coroutine is suspended only when it would return UNAVAILABLE.
+        //TCP 'send' completes after partially sent rest is flushed too.
+        auto receiveInto(TCPClientSocket& clientSocket, DataPacket& dataPacket);
+        auto receiveInto(TCPClientSocket& clientSocket, std::vector<DataPacket>& dataPackets, size_t* receivedPackets);
+        auto send(TCPClientSocket& clientSocket, DataPacket& dataPacket);
+        auto send(TCPClientSocket& clientSocket, std::vector<DataPacket>& dataPackets);
+        auto acceptNewClient(TCPListenSocket& listenSocket, TCPClientSocket& newClient);
+        //Reactor has no timers, so connection can't time out before kernel gives up on it
+        auto connect(TCPClientSocket& clientSocket, const Endpoint& server);
+        auto receiveInto(UDPSocket& udpSocket, DataPacket& dataPacket);
+        auto sendTo(UDPSocket& udpSocket, DataPacket& dataPacket, const Endpoint& receiver);
+#endif
+
+    private:
+        struct Waiters{
+            Resume reader;
+            void* readerData;
+            Resume writer;
+            void* writerData;
+            bool registered;
+        };
+
+        Poller poller;
+        std::unordered_map<int, Waiters> waiters;//Entries are kept, FDs are reused
+        std::vector<PollEvent> readyEvents;
+        size_t waitingCount;
+
+        template<typename SocketType>
+        Status wait(SocketType& socket, const Interest interest, Resume resume, void* waiter);
+};
+
+struct TCPServerConfig {
+    TCPServerConfig() : ioThreads(1), workerThreads(0), backlog(128), queueCapacity(4096) {}
+
+    size_t ioThreads;//Every one accepts on its own listening shard and owns accepted connections, up to 256
+    size_t workerThreads;//0 runs handler on I/O thread owning the connection
+    std::vector<int> ioThreadCpus;//Empty or CPU for every I/O thread, its shard prefers connections handled there
+    std::vector<int> workerThreadCpus;//Empty or CPU for every worker thread
+    int backlog;
+    size_t queueCapacity;//Tasks waiting in queue of every thread, rounded up to power of 2
+};
+
+struct TCPServerStats {
+    SocketStats sockets;//All accepted connections
+    std::uint64_t connections;//Open now
+    std::uint64_t handledPackets;
+    std::uint64_t tasks;//DataPackets of one connection handled together
+    std::uint64_t stolenTasks;//Taken by worker from queue of other worker
+    std::uint64_t inlineTasks;//Handled on I/O thread, as there are no workers or their queues were full
+};
+
+//Accepts connections on I/O threads (one Poller and listening shard per thread)
+//and handles received DataPackets on pool of worker threads, which steal tasks 
+//from each other when their own queue is empty. Responses are sent by I/O thread
+//owning the connection. DataPackets of one connection are handled in order,
+//by one thread at a time. Queues between threads are lock free.
+class TCPServer {
+    public:
+        //Lowest 8 bits are index of owning I/O thread
+        typedef std::uint64_t ConnectionID;
+
+        //Called for every received DataPacket, appended DataPackets are sent back in order.
+        //Runs on worker threads (or I/O threads when there are no workers), so it's called
+        //for different connections at the same time. It must not throw.
+        typedef std::function<void(const ConnectionID connection, DataPacket& request, std::vector<DataPacket>& responses)> Handler;
+
+        //Called on I/O thread owning the connection.
+        typedef std::function<void(const ConnectionID connection)> ConnectionCallback;
+
+        TCPServer(const TCPServerConfig& config = TCPServerConfig());
+
+        ~TCPServer();
+
+        //Callbacks have to be set before 'start'.
+        void setConnectCallback(ConnectionCallback callback);
+        void setDisconnectCallback(ConnectionCallback callback);
+
+        //Starts all threads, they are pinned when CPUs are configured.
+        //On ERROR nothing is left running.
+        Status start(const short port, Handler handler);
+
+        //Disconnects all clients and joins threads. Tasks not handled yet are dropped.
+        Status stop();
+
+        bool isRunning();
+
+        //Sends DataPacket to client after responses already queued for it.
+        //Can be called from any thread (also from handler) while server runs.
+        //UNAVAILABLE when queue of owning I/O thread is full, then 'dataPacket' is not taken.
+        Status send(const ConnectionID connection, DataPacket&& dataPacket);
+
+        //Disconnects client after its queued DataPackets are sent and its current task is handled.
+        //Can be called from any thread while server runs.
+        Status disconnect(const ConnectionID connection);
+
+        TCPServerStats getStats();
+
+    private:
+        struct Task;
+        struct TaskQueue;
+        struct Connection;
+        struct IOThread;
+        struct Worker;
+
+        TCPServerConfig config;
+        Handler handler;
+        ConnectionCallback connectCallback;
+        ConnectionCallback disconnectCallback;
+        std::unique_ptr<TCPShardedListenSocket> listenSocket;
+        std::vector<std::unique_ptr<IOThread>> ioThreads;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> running;
+        std::atomic<std::uint32_t> workSignal;//Futex of sleeping workers
+        std::atomic<std::uint32_t> sleepingWorkers;
+
+        void runIOThread(IOThread& ioThread);
+        void runWorker(Worker& worker);
+        void acceptClients(IOThread& ioThread);
+        void receive(IOThread& ioThread, Connection& connection);
+        void dispatch(IOThread& ioThread, Connection& connection);
+        void handle(Task& task);
+        Connection* complete(IOThread& ioThread, Task& task);
+        void flush(Connection& connection);
+        void update(IOThread& ioThread, Connection& connection);
+        void closeConnection(IOThread& ioThread, Connection& connection);
+        Task* stealTask(const size_t thief);
+        void wakeIOThread(IOThread& ioThread);
+        void wakeWorker();
+        Status pushCompletion(IOThread& ioThread, Task* task);
+};
+
+#if __cplusplus >= 202002L
+namespace API_RESERVED {
+template<typename SocketType, typename Operation>
+class Awaiter {
+    public:
+        Awaiter(Reactor& reactor, SocketType& socket, const Interest interest, Operation operation) 
+            : reactor(reactor), socket(socket), interest(interest), operation(operation), status(Status::ERROR) {}
+
+        bool await_ready() {
+            status = operation();
+            return status != Status::UNAVAILABLE;
+        }
+
+        bool await_suspend(std::coroutine_handle<> coroutine) {
+            this->coroutine = coroutine;
+            if(reactor.wait(socket, interest, &Awaiter::resume, this) == Status::OK)
+                return true;
+
+            status = Status::ERROR;
+            return false;
+        }
+
+        Status await_resume() {
+            return status;
+        }
+
+    private:
+        Reactor& reactor;
+        SocketType& socket;
+        Interest interest;
+        Operation operation;
+        Status status;
+        std::coroutine_handle<> coroutine;
+
+        static void resume(void* waiter) {
+            Awaiter& awaiter = *static_cast<Awaiter*>(waiter);
+            awaiter.status = awaiter.operation();
+
+            //Socket can be reported ready when other operation already took its data,
+            //then coroutine stays suspended until next readiness
+            if(awaiter.status == Status::UNAVAILABLE){
+                if(awaiter.reactor.wait(awaiter.socket, awaiter.interest, &Awaiter::resume, waiter) == Status::OK)
+                    return;
+
+                awaiter.status = Status::ERROR;
+            }
+
+            awaiter.coroutine.resume();
+        }
+};
+
+template<typename SocketType, typename Operation>
+Awaiter<SocketType, Operation> makeAwaiter(Reactor& reactor, SocketType& socket, const Interest interest, Operation operation) {
+    return Awaiter<SocketType, Operation>(reactor, socket, interest, operation);
+}
+}
+
+inline auto Reactor::receiveInto(TCPClientSocket& clientSocket, DataPacket& dataPacket) {
+    return API_RESERVED::makeAwaiter(*this, clientSocket, Interest::READ, [&clientSocket, &dataPacket]{ return clientSocket.receiveInto(dataPacket); });
+}
+
+inline auto Reactor::receiveInto(TCPClientSocket& clientSocket, std::vector<DataPacket>& dataPackets, size_t* receivedPackets) {
+    return API_RESERVED::makeAwaiter(*this, clientSocket, Interest::READ, [&clientSocket, &dataPackets, receivedPackets]{ return clientSocket.receiveInto(dataPackets, receivedPackets); });
+}
+
+inline auto Reactor::send(TCPClientSocket& clientSocket, DataPacket& dataPacket) {
+    return API_RESERVED::makeAwaiter(*this, clientSocket, Interest::WRITE, [&clientSocket, &dataPacket, sent = false]() mutable {
+        if(sent == false){
+            const Status status = clientSocket.send(dataPacket);
+            if(status != Status::OK)
+                return status;
+            sent = true;
+        }
+        return clientSocket.flush();
+    });
+}
+
+inline auto Reactor::send(TCPClientSocket& clientSocket, std::vector<DataPacket>& dataPackets) {
+    return API_RESERVED::makeAwaiter(*this, clientSocket, Interest::WRITE, [&clientSocket, &dataPackets, sent = false]() mutable {
+        if(sent == false){
+            const Status status = clientSocket.send(dataPackets);
+            if(status != Status::OK)
+                return status;
+            sent = true;
+        }
+        return clientSocket.flush();
+    });
+}
+
+inline auto Reactor::acceptNewClient(TCPListenSocket& listenSocket, TCPClientSocket& newClient) {
+    return API_RESERVED::makeAwaiter(*this, listenSocket, Interest::READ, [&listenSocket, &newClient]{ return listenSocket.acceptNewClient(newClient); });
+}
+
+inline auto Reactor::connect(TCPClientSocket& clientSocket, const Endpoint& server) {
+    return API_RESERVED::makeAwaiter(*this, clientSocket, Interest::WRITE, [&clientSocket, server]{ return clientSocket.connect(server); });
+}
+
+inline auto Reactor::receiveInto(UDPSocket& udpSocket, DataPacket& dataPacket) {
+    return API_RESERVED::makeAwaiter(*this, udpSocket, Interest::READ, [&udpSocket, &dataPacket]{ return udpSocket.receiveInto(dataPacket); });
+}
+
+inline auto Reactor::sendTo(UDPSocket& udpSocket, DataPacket& dataPacket, const Endpoint& receiver) {
+    return API_RESERVED::makeAwaiter(*this, udpSocket, Interest::WRITE, [&udpSocket, &dataPacket, &receiver]{ return udpSocket.sendTo(dataPacket, receiver); });
+}
+#endif
 }//namespace sj
\ No newline at end of file
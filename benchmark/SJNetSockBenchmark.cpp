@@ -0,0 +1,1094 @@
+//
+// Simple Network Sockets library for Windows and Linux
+
+// Copyright (C) 2020  Jakub Stawiski
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+//Loopback (127.0.0.1) benchmarks of SJNetSock.
+//Every result is printed as one JSON object per line, so runs of different versions can be compared.
+//Usage: SJNetSockBenchmark [--quick] [filter]
+//  --quick  fewer iterations, for smoke runs
+//  filter   runs only benchmarks which name contains it (e.g. "tcp", "latency")
+
+#include "SJNetSock.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace sj;
+
+typedef std::chrono::steady_clock Clock;
+
+static bool quick = false;
+static const char* filter = "";
+static short nextPort = 27100;
+
+struct PacketFields{
+    std::int32_t id;
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t z;
+    SJ_DATAPACKET_FIELDS(id, x, y, z)
+};
+
+
+//One line of output: {"benchmark":"name","key":value,...}
+class Result {
+    public:
+        Result(const char* benchmark) : line(std::string("{\"benchmark\":\"") + benchmark + "\"") {}
+
+        ~Result(){
+            std::printf("%s}\n", line.c_str());
+            std::fflush(stdout);
+        }
+
+        Result& add(const char* key, const double value){
+            char number[64];
+            std::snprintf(number, sizeof(number), "%.6g", value);
+            line += std::string(",\"") + key + "\":" + number;
+            return *this;
+        }
+
+        Result& add(const char* key, const std::uint64_t value){
+            line += std::string(",\"") + key + "\":" + std::to_string(value);
+            return *this;
+        }
+
+        Result& add(const char* key, const char* value){
+            line += std::string(",\"") + key + "\":\"" + value + "\"";
+            return *this;
+        }
+
+    private:
+        std::string line;
+};
+
+
+///////////////////////////////////////////////
+static bool selected(const char* benchmark) {
+    return std::strstr(benchmark, filter) != nullptr;
+}
+
+
+///////////////////////////////////////////////
+static double secondsSince(const Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+///////////////////////////////////////////////
+static const char* modeName(const Mode mode) {
+    return mode == Mode::BLOCKING ? "blocking" : "non_blocking";
+}
+
+
+///////////////////////////////////////////////
+static void printFailure(const char* benchmark, const char* reason) {
+    Result(benchmark).add("error", reason);
+}
+
+
+//Ports of previous runs can be still taken (TIME_WAIT), so next free one is used.
+//Returns 0 when none was found.
+static short listenOnFreePort(TCPListenSocket& listenSocket, const int backlog) {
+    for(int attempt = 0; attempt < 1000; attempt++){
+        const short port = nextPort++;
+        if(listenSocket.beginListening(port, backlog, false) == Status::OK)
+            return port;
+    }
+
+    return 0;
+}
+
+
+///////////////////////////////////////////////
+template<typename Socket>
+static short bindFreePort(Socket& udpSocket) {
+    for(int attempt = 0; attempt < 1000; attempt++){
+        const short port = nextPort++;
+        if(udpSocket.bind(port) == Status::OK)
+            return port;
+    }
+
+    return 0;
+}
+
+
+//Connects 'clients' to new listening socket and accepts them into 'servers'.
+static bool connectClients(std::vector<std::unique_ptr<TCPClientSocket>>& clients, std::vector<std::unique_ptr<TCPClientSocket>>& servers, const Mode serverMode) {
+    TCPListenSocket listenSocket(Mode::BLOCKING);
+    const short port = listenOnFreePort(listenSocket, (int) clients.size() + 16);
+    if(port == 0)
+        return false;
+
+    //Connections wait in backlog until they are accepted
+    std::vector<TCPClientSocket*> clientSockets;
+    for(auto& client : clients){
+        client->setOption(Option::NO_DELAY, 1);
+        clientSockets.push_back(client.get());
+    }
+    size_t connectedSockets;
+    if(TCPClientSocket::connect(clientSockets, {Endpoint("127.0.0.1", port)}, 5000, &connectedSockets) != Status::OK)
+        return false;
+
+    servers.clear();
+    for(size_t i = 0; i < clients.size(); i++){
+        servers.emplace_back(new TCPClientSocket(serverMode));
+        servers.back()->setOption(Option::NO_DELAY, 1);
+        if(listenSocket.acceptNewClient(*servers.back()) != Status::OK)
+            return false;
+    }
+
+    return true;
+}
+
+
+//Nanoseconds at 'percentile' of sorted samples
+static double percentile(const std::vector<std::uint64_t>& sortedSamples, const double percentile) {
+    const size_t index = std::min(sortedSamples.size() - 1, (size_t) (percentile / 100.0 * sortedSamples.size()));
+    return (double) sortedSamples[index];
+}
+
+
+///////////////////////////////////////////////
+static void benchmarkTCPThroughput(const size_t packetSize) {
+    const char* const benchmark = "tcp_throughput";
+    std::vector<std::unique_ptr<TCPClientSocket>> clients, servers;
+    clients.emplace_back(new TCPClientSocket(Mode::BLOCKING));
+    if(connectClients(clients, servers, Mode::BLOCKING) == false)
+        return printFailure(benchmark, "connect");
+
+    TCPClientSocket& client = *clients[0];
+    TCPClientSocket& server = *servers[0];
+    const size_t totalBytes = quick ? (32 << 20) : (512 << 20);
+    const size_t packetsCount = std::min<size_t>(std::max<size_t>(totalBytes / packetSize, 1), quick ? 200000 : 4000000);
+    const std::string payload(packetSize, 'x');
+
+    const Clock::time_point start = Clock::now();
+    std::thread sender([&](){
+        std::vector<DataPacket> batch;
+        size_t sentPackets = 0;
+        while(sentPackets < packetsCount){
+            batch.resize(std::min<size_t>(64, packetsCount - sentPackets));
+            for(auto& dataPacket : batch){
+                dataPacket.clear();
+                dataPacket.writeBytes(payload.data(), payload.size());
+            }
+
+            if(client.send(batch) != Status::OK)
+                break;
+            sentPackets += batch.size();
+        }
+    });
+
+    size_t receivedPackets = 0;
+    std::vector<DataPacket> dataPackets;
+    while(receivedPackets < packetsCount){
+        size_t newPackets;
+        if(server.receiveInto(dataPackets, &newPackets) != Status::OK)
+            break;
+
+        receivedPackets += newPackets;
+        DataPacketPool::local().release(dataPackets);
+    }
+    const double seconds = secondsSince(start);
+    sender.join();
+
+    Result(benchmark)
+        .add("packet_size", packetSize)
+        .add("packets", receivedPackets)
+        .add("messages_per_second", receivedPackets / seconds)
+        .add("megabytes_per_second", receivedPackets * packetSize / seconds / 1e6);
+}
+
+
+///////////////////////////////////////////////
+//With 'offload' batches are sent as GSO buffers and received joined by GRO
+static void benchmarkUDPThroughput(const size_t packetSize, const bool offload) {
+    const char* const benchmark = "udp_throughput";
+    UDPSocket sender(Mode::BLOCKING);
+    UDPSocket receiver(Mode::NON_BLOCKING);
+    receiver.setOption(Option::RECEIVE_BUFFER_SIZE, 8 << 20);
+    if(offload && (sender.setOption(Option::SEGMENTATION_OFFLOAD, 1) != Status::OK || receiver.setOption(Option::RECEIVE_OFFLOAD, 1) != Status::OK))
+        return printFailure(benchmark, "offload");
+    const short port = bindFreePort(receiver);
+    if(port == 0 || bindFreePort(sender) == 0)
+        return printFailure(benchmark, "bind");
+
+    const Endpoint receiverEndpoint("127.0.0.1", port);
+    const size_t packetsCount = quick ? 50000 : 1000000;
+    const std::string payload(packetSize, 'x');
+    std::atomic<bool> sendingDone(false);
+    size_t sentPackets = 0;
+
+    const Clock::time_point start = Clock::now();
+    std::thread senderThread([&](){
+        std::vector<DataPacket> batch;
+        while(sentPackets < packetsCount){
+            batch.resize(std::min<size_t>(64, packetsCount - sentPackets));
+            for(auto& dataPacket : batch){
+                dataPacket.clear();
+                dataPacket.writeBytes(payload.data(), payload.size());
+            }
+
+            size_t batchSent;
+            if(sender.sendBatch(batch, receiverEndpoint, &batchSent) != Status::OK)
+                break;
+            sentPackets += batchSent;
+        }
+        sendingDone = true;
+    });
+
+    //Lost datagrams are expected, receiving stops after sender is done and socket is idle
+    size_t receivedPackets = 0;
+    std::vector<DataPacket> dataPackets;
+    Clock::time_point lastReceive = Clock::now();
+    while(receivedPackets < packetsCount){
+        size_t newPackets;
+        const Status status = receiver.receiveBatch(dataPackets, 64, &newPackets);
+        if(status == Status::OK){
+            receivedPackets += newPackets;
+            lastReceive = Clock::now();
+            DataPacketPool::local().release(dataPackets);
+        }
+        else if(status == Status::UNAVAILABLE){
+            if(sendingDone && secondsSince(lastReceive) > 0.1)
+                break;
+            std::this_thread::yield();
+        }
+        else
+            break;
+    }
+    const double seconds = std::chrono::duration<double>(lastReceive - start).count();
+    senderThread.join();
+
+    Result(benchmark)
+        .add("packet_size", packetSize)
+        .add("offload", offload ? "gso_gro" : "none")
+        .add("packets_sent", sentPackets)
+        .add("packets", receivedPackets)
+        .add("loss_ratio", sentPackets != 0 ? 1.0 - (double) receivedPackets / sentPackets : 0.0)
+        .add("messages_per_second", receivedPackets / seconds)
+        .add("megabytes_per_second", receivedPackets * packetSize / seconds / 1e6);
+}
+
+
+//Cost of sending one message to every subscriber, with 'sendTo' to each of them or one multicast 'publish'.
+//Subscribers are drained between rounds, which is not counted.
+static void benchmarkFanOut(const size_t subscribersCount, const bool multicast) {
+    const char* const benchmark = "udp_fan_out";
+    const size_t messagesCount = quick ? 2000 : 20000;
+    const std::string group = "239.255.42.1";
+    std::vector<std::unique_ptr<UDPSocket>> subscribers;
+    std::vector<Endpoint> receivers;
+    const short groupPort = nextPort++;
+    for(size_t i = 0; i < subscribersCount; i++){
+        subscribers.emplace_back(new UDPSocket(Mode::NON_BLOCKING));
+        UDPSocket& subscriber = *subscribers.back();
+        subscriber.setOption(Option::RECEIVE_BUFFER_SIZE, 4 << 20);
+        if(multicast){
+            subscriber.setOption(Option::REUSE_ADDRESS, 1);
+            if(subscriber.bind(Endpoint(group, groupPort)) != Status::OK || subscriber.joinGroup(group, "127.0.0.1") != Status::OK)
+                return printFailure(benchmark, "join");
+        }
+        else{
+            const short port = bindFreePort(subscriber);
+            if(port == 0)
+                return printFailure(benchmark, "bind");
+            receivers.push_back(Endpoint("127.0.0.1", port));
+        }
+    }
+
+    UDPSocket sender(Mode::BLOCKING);
+    MulticastPublisher publisher(Mode::BLOCKING);
+    if(multicast ? publisher.open(Endpoint(group, groupPort), "127.0.0.1") != Status::OK : bindFreePort(sender) == 0)
+        return printFailure(benchmark, "open");
+
+    const std::string payload(256, 'x');
+    DataPacket dataPacket;
+    dataPacket.writeBytes(payload.data(), payload.size());
+    std::vector<DataPacket> received;
+    double sendSeconds = 0;
+    size_t receivedPackets = 0;
+    for(size_t sentMessages = 0; sentMessages < messagesCount;){
+        const size_t roundMessages = std::min<size_t>(64, messagesCount - sentMessages);
+        const Clock::time_point start = Clock::now();
+        for(size_t i = 0; i < roundMessages; i++){
+            if(multicast)
+                publisher.publish(dataPacket);
+            else{
+                for(const Endpoint& receiver : receivers)
+                    sender.sendTo(dataPacket, receiver);
+            }
+        }
+        sendSeconds += secondsSince(start);
+        sentMessages += roundMessages;
+
+        for(std::unique_ptr<UDPSocket>& subscriber : subscribers){
+            size_t newPackets;
+            while(subscriber->receiveBatch(received, 64, &newPackets) == Status::OK){
+                receivedPackets += newPackets;
+                DataPacketPool::local().release(received);
+            }
+        }
+    }
+
+    Result(benchmark)
+        .add("method", multicast ? "multicast_publish" : "unicast_send_to")
+        .add("subscribers", subscribersCount)
+        .add("messages", messagesCount)
+        .add("sender_ns_per_message", sendSeconds * 1e9 / messagesCount)
+        .add("delivered_ratio", (double) receivedPackets / (messagesCount * subscribersCount));
+}
+
+
+//Messages of 4 reliable streams through LinkSimulation with given loss, latency is counted from 'send' to delivery.
+static void benchmarkReliableDelivery(const double lossRatio) {
+    const char* const benchmark = "reliable_udp_delivery";
+    const size_t messagesCount = quick ? 5000 : 50000;
+    const int delayMs = 5;
+    ReliableUDPSocket sender(Mode::BLOCKING);
+    ReliableUDPSocket receiver(Mode::BLOCKING);
+    const short port = bindFreePort(receiver);
+    if(port == 0 || bindFreePort(sender) == 0 || sender.connect(Endpoint("127.0.0.1", port)) != Status::OK)
+        return printFailure(benchmark, "bind");
+    sender.setLinkSimulation(LinkSimulation{lossRatio, delayMs, 0, 1});
+    receiver.setLinkSimulation(LinkSimulation{lossRatio, delayMs, 0, 2});
+
+    std::atomic<bool> sendingDone(false);
+    std::vector<std::uint64_t> samples;
+    samples.reserve(messagesCount);
+    std::thread receiverThread([&](){
+        DataPacket dataPacket;
+        while(samples.size() < messagesCount && receiver.receiveInto(dataPacket) == Status::OK){
+            std::uint64_t sendTime = 0;
+            dataPacket >> sendTime;
+            samples.push_back(Clock::now().time_since_epoch().count() - sendTime);
+        }
+        //Acknowledgements are sent only from inside calls
+        while(sendingDone == false)
+            receiver.flush(1);
+    });
+
+    const std::string payload(256, 'x');
+    const Clock::time_point start = Clock::now();
+    bool sent = true;
+    for(size_t i = 0; i < messagesCount && sent; i++){
+        DataPacket dataPacket;
+        dataPacket << (std::uint64_t) Clock::now().time_since_epoch().count();
+        dataPacket.writeBytes(payload.data(), payload.size());
+        sent = sender.send(dataPacket, (std::uint8_t) (i % 4)) == Status::OK;
+    }
+    const bool flushed = sent && sender.flush(30000) == Status::OK;
+    const double seconds = secondsSince(start);
+    sendingDone = true;
+    receiverThread.join();
+    if(flushed == false || samples.size() != messagesCount)
+        return printFailure(benchmark, "delivery");
+
+    const ReliableStats stats = sender.getStats();
+    std::sort(samples.begin(), samples.end());
+    Result(benchmark)
+        .add("loss_ratio", lossRatio)
+        .add("delay_ms", (std::uint64_t) delayMs)
+        .add("messages", messagesCount)
+        .add("messages_per_second", messagesCount / seconds)
+        .add("retransmitted_messages", stats.retransmittedMessages)
+        .add("smoothed_rtt_ns", stats.smoothedRttNanoseconds)
+        .add("p50_ns", percentile(samples, 50))
+        .add("p99_ns", percentile(samples, 99));
+}
+
+
+///////////////////////////////////////////////
+static void printLatency(const char* benchmark, const size_t packetSize, std::vector<std::uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    Result(benchmark)
+        .add("packet_size", packetSize)
+        .add("round_trips", samples.size())
+        .add("p50_ns", percentile(samples, 50))
+        .add("p90_ns", percentile(samples, 90))
+        .add("p99_ns", percentile(samples, 99))
+        .add("p999_ns", percentile(samples, 99.9))
+        .add("max_ns", samples.back());
+}
+
+
+//Echo round trips between two connected sockets of any transport with send/receiveInto,
+//returns nanoseconds of every measured one
+template<typename Socket>
+static std::vector<std::uint64_t> measureRoundTrips(Socket& client, Socket& server, const size_t packetSize) {
+    const size_t warmupRoundTrips = 1000;
+    const size_t roundTrips = quick ? 5000 : 100000;
+
+    std::thread echo([&](){
+        DataPacket dataPacket;
+        for(size_t i = 0; i < warmupRoundTrips + roundTrips; i++){
+            dataPacket.clear();
+            if(server.receiveInto(dataPacket) != Status::OK || server.send(dataPacket) != Status::OK)
+                break;
+        }
+    });
+
+    const std::string payload(packetSize, 'x');
+    std::vector<std::uint64_t> samples;
+    samples.reserve(roundTrips);
+    DataPacket request, response;
+    request.writeBytes(payload.data(), payload.size());
+    for(size_t i = 0; i < warmupRoundTrips + roundTrips; i++){
+        const Clock::time_point start = Clock::now();
+        response.clear();
+        if(client.send(request) != Status::OK || client.receiveInto(response) != Status::OK)
+            break;
+
+        if(i >= warmupRoundTrips)
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    echo.join();
+
+    return samples;
+}
+
+
+///////////////////////////////////////////////
+static void benchmarkTCPLatency(const size_t packetSize) {
+    const char* const benchmark = "tcp_latency";
+    std::vector<std::unique_ptr<TCPClientSocket>> clients, servers;
+    clients.emplace_back(new TCPClientSocket(Mode::BLOCKING));
+    if(connectClients(clients, servers, Mode::BLOCKING) == false)
+        return printFailure(benchmark, "connect");
+
+    std::vector<std::uint64_t> samples = measureRoundTrips(*clients[0], *servers[0], packetSize);
+    if(samples.empty())
+        return printFailure(benchmark, "round trip");
+    printLatency(benchmark, packetSize, samples);
+}
+
+
+//The same as tcp_latency, through Unix domain socket
+static void benchmarkUnixLatency(const size_t packetSize) {
+    const char* const benchmark = "unix_latency";
+    const Endpoint local = Endpoint::unixSocket("@SJNetSockBenchmark-" + std::to_string(getpid()));
+    TCPListenSocket listenSocket(Mode::BLOCKING);
+    TCPClientSocket client(Mode::BLOCKING), server(Mode::BLOCKING);
+    if(listenSocket.beginListening(local) != Status::OK || client.connect(local) != Status::OK || listenSocket.acceptNewClient(server) != Status::OK)
+        return printFailure(benchmark, "connect");
+
+    std::vector<std::uint64_t> samples = measureRoundTrips(client, server, packetSize);
+    if(samples.empty())
+        return printFailure(benchmark, "round trip");
+    printLatency(benchmark, packetSize, samples);
+}
+
+
+//Sleeping on futex, or spinning before it with 'busyPollMicroseconds'
+static void benchmarkSharedMemoryLatency(const size_t packetSize, const int busyPollMicroseconds) {
+    const char* const benchmark = busyPollMicroseconds == 0 ? "shared_memory_latency" : "shared_memory_busy_poll_latency";
+    const std::string name = "/SJNetSockBenchmark-" + std::to_string(getpid());
+    SharedMemorySocket client(Mode::BLOCKING), server(Mode::BLOCKING);
+    if(client.create(name) != Status::OK || server.open(name) != Status::OK)
+        return printFailure(benchmark, "connect");
+    client.setBusyPoll(busyPollMicroseconds);
+    server.setBusyPoll(busyPollMicroseconds);
+
+    std::vector<std::uint64_t> samples = measureRoundTrips(client, server, packetSize);
+    if(samples.empty())
+        return printFailure(benchmark, "round trip");
+    printLatency(benchmark, packetSize, samples);
+}
+
+
+///////////////////////////////////////////////
+static void benchmarkUDPLatency(const size_t packetSize) {
+    const char* const benchmark = "udp_latency";
+    UDPSocket client(Mode::BLOCKING);
+    UDPSocket server(Mode::BLOCKING);
+    const short clientPort = bindFreePort(client);
+    const short serverPort = bindFreePort(server);
+    if(clientPort == 0 || serverPort == 0)
+        return printFailure(benchmark, "bind");
+
+    if(client.connect(Endpoint("127.0.0.1", serverPort)) != Status::OK || server.connect(Endpoint("127.0.0.1", clientPort)) != Status::OK)
+        return printFailure(benchmark, "connect");
+
+    const size_t warmupRoundTrips = 1000;
+    const size_t roundTrips = quick ? 5000 : 100000;
+
+    std::thread echo([&](){
+        DataPacket dataPacket;
+        for(size_t i = 0; i < warmupRoundTrips + roundTrips; i++){
+            dataPacket.clear();
+            if(server.receiveInto(dataPacket) != Status::OK || server.send(dataPacket) != Status::OK)
+                break;
+        }
+    });
+
+    const std::string payload(packetSize, 'x');
+    std::vector<std::uint64_t> samples;
+    samples.reserve(roundTrips);
+    DataPacket request, response;
+    request.writeBytes(payload.data(), payload.size());
+    for(size_t i = 0; i < warmupRoundTrips + roundTrips; i++){
+        const Clock::time_point start = Clock::now();
+        response.clear();
+        if(client.send(request) != Status::OK || client.receiveInto(response) != Status::OK)
+            break;
+
+        if(i >= warmupRoundTrips)
+            samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    echo.join();
+
+    if(samples.empty())
+        return printFailure(benchmark, "round trip");
+    printLatency(benchmark, packetSize, samples);
+}
+
+
+//Best of few rounds, so single preemption does not spoil the result
+template<typename Function>
+static double bestNanosecondsPerField(const size_t fieldsPerRound, Function function) {
+    double best = 1e30;
+    for(int round = 0; round < (quick ? 3 : 10); round++){
+        const Clock::time_point start = Clock::now();
+        function();
+        best = std::min(best, secondsSince(start) * 1e9 / fieldsPerRound);
+    }
+
+    return best;
+}
+
+
+///////////////////////////////////////////////
+static void benchmarkDataPacket() {
+    const size_t fieldsCount = quick ? 100000 : 1000000;
+    DataPacket dataPacket;
+    volatile std::int64_t sink = 0;
+
+    const double int32Encode = bestNanosecondsPerField(fieldsCount, [&](){
+        dataPacket.clear();
+        for(size_t i = 0; i < fieldsCount; i++)
+            dataPacket << (std::int32_t) i;
+    });
+    const double int32Decode = bestNanosecondsPerField(fieldsCount, [&](){
+        DataPacket readPacket(dataPacket);
+        std::int64_t sum = 0;
+        for(size_t i = 0; i < fieldsCount; i++){
+            std::int32_t value;
+            readPacket >> value;
+            sum += value;
+        }
+        sink = sum;
+    });
+    Result("datapacket_codec").add("field", "int32").add("encode_ns_per_field", int32Encode).add("decode_ns_per_field", int32Decode);
+
+    const size_t structsCount = fieldsCount / 4;
+    const double structEncode = bestNanosecondsPerField(fieldsCount, [&](){
+        dataPacket.clear();
+        for(size_t i = 0; i < structsCount; i++){
+            const PacketFields fields = {(std::int32_t) i, 1, 2, 3};
+            dataPacket << fields;
+        }
+    });
+    const double structDecode = bestNanosecondsPerField(fieldsCount, [&](){
+        DataPacket readPacket(dataPacket);
+        std::int64_t sum = 0;
+        for(size_t i = 0; i < structsCount; i++){
+            PacketFields fields = {0, 0, 0, 0};
+            readPacket >> fields;
+            sum += fields.id;
+        }
+        sink = sum;
+    });
+    Result("datapacket_codec").add("field", "struct_4xint32").add("encode_ns_per_field", structEncode).add("decode_ns_per_field", structDecode);
+
+    const std::string text(32, 't');
+    const size_t stringsCount = fieldsCount / 4;
+    const double stringEncode = bestNanosecondsPerField(stringsCount, [&](){
+        dataPacket.clear();
+        for(size_t i = 0; i < stringsCount; i++)
+            dataPacket << text;
+    });
+    const double stringDecode = bestNanosecondsPerField(stringsCount, [&](){
+        DataPacket readPacket(dataPacket);
+        std::int64_t sum = 0;
+        std::string value;
+        for(size_t i = 0; i < stringsCount; i++){
+            readPacket >> value;
+            sum += value.size();
+        }
+        sink = sum;
+    });
+    const double viewDecode = bestNanosecondsPerField(stringsCount, [&](){
+        DataPacket readPacket(dataPacket);
+        std::int64_t sum = 0;
+        BytesView value;
+        for(size_t i = 0; i < stringsCount; i++){
+            readPacket >> value;
+            sum += value.size();
+        }
+        sink = sum;
+    });
+    Result("datapacket_codec").add("field", "string_32").add("encode_ns_per_field", stringEncode).add("decode_ns_per_field", stringDecode);
+    Result("datapacket_codec").add("field", "bytes_view_32").add("encode_ns_per_field", stringEncode).add("decode_ns_per_field", viewDecode);
+    (void) sink;
+}
+
+
+//Every connection has one request in flight, thread per connection on both sides
+static void benchmarkBlockingScaling(const size_t connectionsCount, const double duration) {
+    const char* const benchmark = "tcp_connections";
+    std::vector<std::unique_ptr<TCPClientSocket>> clients, servers;
+    for(size_t i = 0; i < connectionsCount; i++)
+        clients.emplace_back(new TCPClientSocket(Mode::BLOCKING));
+    if(connectClients(clients, servers, Mode::BLOCKING) == false)
+        return printFailure(benchmark, "connect");
+
+    std::atomic<bool> stop(false);
+    std::atomic<std::uint64_t> roundTrips(0);
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < connectionsCount; i++){
+        TCPClientSocket& server = *servers[i];
+        threads.emplace_back([&server](){
+            DataPacket dataPacket;
+            while(true){
+                dataPacket.clear();
+                if(server.receiveInto(dataPacket) != Status::OK || server.send(dataPacket) != Status::OK)
+                    break;
+            }
+        });
+
+        TCPClientSocket& client = *clients[i];
+        threads.emplace_back([&client, &stop, &roundTrips](){
+            DataPacket request, response;
+            request << (std::int64_t) 0;
+            while(stop == false){
+                response.clear();
+                if(client.send(request) != Status::OK || client.receiveInto(response) != Status::OK)
+                    break;
+                roundTrips.fetch_add(1, std::memory_order_relaxed);
+            }
+            client.disconnect();
+        });
+    }
+
+    //Counted only between both timestamps, as threads start and stop with delay
+    const Clock::time_point start = Clock::now();
+    const std::uint64_t startRoundTrips = roundTrips;
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    const std::uint64_t measuredRoundTrips = roundTrips - startRoundTrips;
+    const double seconds = secondsSince(start);
+    stop = true;
+    for(auto& thread : threads)
+        thread.join();
+
+    Result(benchmark)
+        .add("mode", modeName(Mode::BLOCKING))
+        .add("connections", connectionsCount)
+        .add("round_trips_per_second", measuredRoundTrips / seconds);
+}
+
+
+//Every connection has one request in flight, one Poller thread on each side
+static void benchmarkNonBlockingScaling(const size_t connectionsCount, const double duration) {
+    const char* const benchmark = "tcp_connections";
+    std::vector<std::unique_ptr<TCPClientSocket>> clients, servers;
+    for(size_t i = 0; i < connectionsCount; i++)
+        clients.emplace_back(new TCPClientSocket(Mode::NON_BLOCKING));
+    if(connectClients(clients, servers, Mode::NON_BLOCKING) == false)
+        return printFailure(benchmark, "connect");
+
+    std::atomic<bool> stop(false);
+    std::thread echo([&](){
+        Poller poller;
+        for(auto& server : servers)
+            poller.add(*server, Interest::READ, Trigger::LEVEL, server.get());
+
+        std::vector<PollEvent> events;
+        std::vector<DataPacket> dataPackets;
+        while(stop == false){
+            events.clear();
+            poller.wait(events, 10);
+            for(const PollEvent& event : events){
+                TCPClientSocket& server = *(TCPClientSocket*) event.userData;
+                size_t receivedPackets;
+                while(server.receiveInto(dataPackets, &receivedPackets) == Status::OK){
+                    server.send(dataPackets);
+                    DataPacketPool::local().release(dataPackets);
+                }
+            }
+        }
+    });
+
+    Poller poller;
+    DataPacket request;
+    request << (std::int64_t) 0;
+    for(auto& client : clients){
+        poller.add(*client, Interest::READ, Trigger::LEVEL, client.get());
+        client->send(request);
+    }
+
+    std::uint64_t roundTrips = 0;
+    std::vector<PollEvent> events;
+    std::vector<DataPacket> dataPackets;
+    const Clock::time_point start = Clock::now();
+    while(secondsSince(start) < duration){
+        events.clear();
+        poller.wait(events, 10);
+        for(const PollEvent& event : events){
+            TCPClientSocket& client = *(TCPClientSocket*) event.userData;
+            size_t receivedPackets;
+            while(client.receiveInto(dataPackets, &receivedPackets) == Status::OK){
+                for(size_t i = 0; i < receivedPackets; i++)
+                    client.send(request);
+                roundTrips += receivedPackets;
+                DataPacketPool::local().release(dataPackets);
+            }
+        }
+    }
+    const double seconds = secondsSince(start);
+    stop = true;
+    echo.join();
+
+    Result(benchmark)
+        .add("mode", modeName(Mode::NON_BLOCKING))
+        .add("connections", connectionsCount)
+        .add("round_trips_per_second", roundTrips / seconds);
+}
+
+
+//Requests of many pipelined connections are handled by TCPServer with 'threadsCount' I/O 
+//and worker threads, each request costs few microseconds of handler CPU time
+static void benchmarkServerScaling(const size_t threadsCount, const double duration) {
+    const char* const benchmark = "tcp_server_scaling";
+    const size_t connectionsCount = 64;
+    const size_t window = 16;//Requests in flight per connection
+    TCPServerConfig config;
+    config.ioThreads = threadsCount;
+    config.workerThreads = threadsCount;
+    TCPServer server(config);
+    const TCPServer::Handler handler = [](const TCPServer::ConnectionID, DataPacket& request, std::vector<DataPacket>& responses){
+        std::uint64_t value = 0;
+        request >> value;
+        for(int i = 0; i < 1000; i++)
+            value = (value ^ i) * 0x100000001B3ull;
+
+        //Request is reused, so workers do not allocate
+        request.clear();
+        request << value;
+        responses.push_back(std::move(request));
+    };
+
+    short port = 0;
+    for(int attempt = 0; attempt < 1000 && port == 0; attempt++){
+        if(server.start(nextPort, handler) == Status::OK)
+            port = nextPort;
+        nextPort++;
+    }
+    if(port == 0)
+        return printFailure(benchmark, "start");
+
+    std::vector<std::unique_ptr<TCPClientSocket>> clients;
+    std::vector<TCPClientSocket*> clientSockets;
+    for(size_t i = 0; i < connectionsCount; i++){
+        clients.emplace_back(new TCPClientSocket(Mode::NON_BLOCKING));
+        clientSockets.push_back(clients.back().get());
+    }
+    size_t connectedSockets = 0;
+    if(TCPClientSocket::connect(clientSockets, {Endpoint("127.0.0.1", port)}, 5000, &connectedSockets) != Status::OK)
+        return printFailure(benchmark, "connect");
+
+    //Clients are driven by as many threads as server has, each one with its own Poller
+    std::atomic<bool> stop(false);
+    std::atomic<std::uint64_t> requests(0);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < threadsCount; t++){
+        threads.emplace_back([&, t](){
+            Poller poller;
+            std::vector<DataPacket> batch(window);
+            for(size_t i = t; i < connectionsCount; i += threadsCount){
+                poller.add(*clients[i], Interest::READ, Trigger::LEVEL, clients[i].get());
+                for(auto& dataPacket : batch){
+                    dataPacket.clear();
+                    dataPacket << (std::uint64_t) i;
+                }
+                clients[i]->send(batch);
+            }
+
+            std::vector<PollEvent> events;
+            std::vector<DataPacket> dataPackets;
+            while(stop == false){
+                events.clear();
+                poller.wait(events, 10);
+                for(const PollEvent& event : events){
+                    TCPClientSocket& client = *(TCPClientSocket*) event.userData;
+                    size_t receivedPackets;
+                    if(client.receiveInto(dataPackets, &receivedPackets) != Status::OK)
+                        continue;
+
+                    client.send(dataPackets);
+                    requests.fetch_add(receivedPackets, std::memory_order_relaxed);
+                    DataPacketPool::local().release(dataPackets);
+                }
+            }
+        });
+    }
+
+    const Clock::time_point start = Clock::now();
+    const std::uint64_t startRequests = requests;
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    const std::uint64_t measuredRequests = requests - startRequests;
+    const double seconds = secondsSince(start);
+    stop = true;
+    for(auto& thread : threads)
+        thread.join();
+
+    const TCPServerStats stats = server.getStats();
+    server.stop();
+    Result(benchmark)
+        .add("io_threads", threadsCount)
+        .add("worker_threads", threadsCount)
+        .add("connections", connectionsCount)
+        .add("requests_per_second", measuredRequests / seconds)
+        .add("requests_per_task", stats.tasks != 0 ? (double) stats.handledPackets / stats.tasks : 0.0)
+        .add("stolen_tasks_ratio", stats.tasks != 0 ? (double) stats.stolenTasks / stats.tasks : 0.0);
+}
+
+
+enum struct FileSend{
+    READ_AND_SEND,//pread, copy into DataPacket and send it
+    SEND_FILE,
+    ZERO_COPY//Blob cached in DataPacket, on loopback kernel copies it anyway
+};
+
+
+//Multi-megabyte blobs served from file, CPU time of sending thread shows cost of copies
+static void benchmarkFileTransfer(const size_t fileSize, const FileSend method) {
+    const char* const benchmark = "tcp_file_transfer";
+    char path[] = "/tmp/SJNetSockBenchmarkXXXXXX";
+    const int fd = mkstemp(path);
+    if(fd == -1)
+        return printFailure(benchmark, "file");
+    unlink(path);
+
+    const std::string content(fileSize, 'x');
+    if(write(fd, content.data(), content.size()) != (ssize_t) content.size()){
+        close(fd);
+        return printFailure(benchmark, "file");
+    }
+
+    std::vector<std::unique_ptr<TCPClientSocket>> clients, servers;
+    clients.emplace_back(new TCPClientSocket(Mode::BLOCKING));
+    if(method == FileSend::ZERO_COPY)
+        clients[0]->setOption(Option::ZERO_COPY, 1);
+    if(connectClients(clients, servers, Mode::BLOCKING) == false){
+        close(fd);
+        return printFailure(benchmark, "connect");
+    }
+
+    TCPClientSocket& client = *clients[0];
+    TCPClientSocket& server = *servers[0];
+    const size_t filesCount = std::max<size_t>((quick ? (64 << 20) : (2048ull << 20)) / fileSize, 1);
+
+    double senderCpuSeconds = 0;
+    const Clock::time_point start = Clock::now();
+    std::thread sender([&](){
+        DataPacket dataPacket;
+        std::string readBuffer(fileSize, '\0');
+        if(method == FileSend::ZERO_COPY)
+            dataPacket.writeBytes(content.data(), content.size());
+
+        std::uint32_t sendId = 0;
+        for(size_t i = 0; i < filesCount; i++){
+            Status status = Status::ERROR;
+            if(method == FileSend::SEND_FILE)
+                status = client.sendFile(fd, 0, fileSize);
+            else if(method == FileSend::ZERO_COPY)
+                status = client.sendZeroCopy(dataPacket, &sendId);
+            else if(pread(fd, &readBuffer[0], fileSize, 0) == (ssize_t) fileSize){
+                dataPacket.clear();
+                dataPacket.writeBytes(readBuffer.data(), readBuffer.size());
+                status = client.send(dataPacket);
+            }
+
+            if(status != Status::OK)
+                break;
+        }
+        if(method == FileSend::ZERO_COPY)
+            client.waitForSendCompletion(sendId);
+
+        timespec cpuTime;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+        senderCpuSeconds = cpuTime.tv_sec + cpuTime.tv_nsec / 1e9;
+    });
+
+    size_t receivedFiles = 0;
+    DataPacket dataPacket;
+    while(receivedFiles < filesCount){
+        dataPacket.clear();
+        if(server.receiveInto(dataPacket) != Status::OK)
+            break;
+        receivedFiles++;
+    }
+    const double seconds = secondsSince(start);
+    sender.join();
+    close(fd);
+
+    const char* methodNames[] = {"read_and_send", "send_file", "zero_copy"};
+    Result(benchmark)
+        .add("method", methodNames[(int) method])
+        .add("file_size", fileSize)
+        .add("files", receivedFiles)
+        .add("megabytes_per_second", receivedFiles * fileSize / seconds / 1e6)
+        .add("sender_cpu_seconds_per_gigabyte", senderCpuSeconds / (receivedFiles * fileSize / 1e9));
+}
+
+
+//Time to open all connections, one after another or all handshakes at once
+static void benchmarkConnect(const size_t connectionsCount, const bool parallel) {
+    const char* const benchmark = "tcp_connect_startup";
+    TCPListenSocket listenSocket(Mode::BLOCKING);
+    const short port = listenOnFreePort(listenSocket, (int) connectionsCount + 16);
+    if(port == 0)
+        return printFailure(benchmark, "listen");
+
+    std::vector<std::unique_ptr<TCPClientSocket>> clients;
+    std::vector<TCPClientSocket*> clientSockets;
+    for(size_t i = 0; i < connectionsCount; i++){
+        clients.emplace_back(new TCPClientSocket(Mode::BLOCKING));
+        clientSockets.push_back(clients.back().get());
+    }
+
+    const Endpoint server("127.0.0.1", port);
+    size_t connectedSockets = 0;
+    const Clock::time_point start = Clock::now();
+    if(parallel)
+        TCPClientSocket::connect(clientSockets, {server}, 5000, &connectedSockets);
+    else{
+        for(TCPClientSocket* clientSocket : clientSockets)
+            connectedSockets += clientSocket->connect(server) == Status::OK ? 1 : 0;
+    }
+    const double seconds = secondsSince(start);
+    if(connectedSockets != connectionsCount)
+        return printFailure(benchmark, "connect");
+
+    Result(benchmark)
+        .add("mode", parallel ? "parallel" : "sequential")
+        .add("connections", connectionsCount)
+        .add("milliseconds", seconds * 1000.0)
+        .add("connections_per_second", connectionsCount / seconds);
+}
+
+
+///////////////////////////////////////////////
+int main(int argc, char** argv) {
+    for(int i = 1; i < argc; i++){
+        if(std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else
+            filter = argv[i];
+    }
+
+    if(selected("tcp_throughput")){
+        for(const size_t packetSize : {16, 256, 4096, 65536, 1 << 20})
+            benchmarkTCPThroughput(packetSize);
+    }
+
+    if(selected("tcp_file_transfer")){
+        for(const size_t fileSize : {1 << 20, 16 << 20}){
+            benchmarkFileTransfer(fileSize, FileSend::READ_AND_SEND);
+            benchmarkFileTransfer(fileSize, FileSend::SEND_FILE);
+            benchmarkFileTransfer(fileSize, FileSend::ZERO_COPY);
+        }
+    }
+
+    if(selected("udp_throughput")){
+        for(const size_t packetSize : {16, 256, 1400, 8192, 32768})
+            benchmarkUDPThroughput(packetSize, false);
+        for(const size_t packetSize : {256, 1400})
+            benchmarkUDPThroughput(packetSize, true);
+    }
+
+    if(selected("udp_fan_out")){
+        for(const size_t subscribersCount : {1, 8, 32}){
+            benchmarkFanOut(subscribersCount, false);
+            benchmarkFanOut(subscribersCount, true);
+        }
+    }
+
+    if(selected("reliable_udp_delivery")){
+        for(const double lossRatio : {0.0, 0.01, 0.05})
+            benchmarkReliableDelivery(lossRatio);
+    }
+
+    if(selected("tcp_latency")){
+        for(const size_t packetSize : {16, 1024, 16384})
+            benchmarkTCPLatency(packetSize);
+    }
+
+    if(selected("unix_latency")){
+        for(const size_t packetSize : {16, 1024, 16384})
+            benchmarkUnixLatency(packetSize);
+    }
+
+    //Spinning only helps when both sides have their own CPU
+    if(selected("shared_memory_latency")){
+        for(const size_t packetSize : {16, 1024, 16384}){
+            benchmarkSharedMemoryLatency(packetSize, 0);
+            if(std::thread::hardware_concurrency() > 1)
+                benchmarkSharedMemoryLatency(packetSize, 50);
+        }
+    }
+
+    if(selected("udp_latency")){
+        for(const size_t packetSize : {16, 1024})
+            benchmarkUDPLatency(packetSize);
+    }
+
+    if(selected("datapacket_codec"))
+        benchmarkDataPacket();
+
+    if(selected("tcp_connections")){
+        const double duration = quick ? 0.3 : 2.0;
+        for(const size_t connectionsCount : {1, 8, 64, 256}){
+            benchmarkBlockingScaling(connectionsCount, duration);
+            benchmarkNonBlockingScaling(connectionsCount, duration);
+        }
+    }
+
+    //More threads than CPUs would measure only their contention
+    if(selected("tcp_server_scaling")){
+        const double duration = quick ? 0.3 : 2.0;
+        for(const size_t threadsCount : {1, 2, 4, 8, 16}){
+            if(threadsCount == 1 || threadsCount <= std::thread::hardware_concurrency())
+                benchmarkServerScaling(threadsCount, duration);
+        }
+    }
+
+    if(selected("tcp_connect_startup")){
+        for(const size_t connectionsCount : {16, 256}){
+            benchmarkConnect(connectionsCount, false);
+            benchmarkConnect(connectionsCount, true);
+        }
+    }
+
+    return 0;
+}